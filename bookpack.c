@@ -0,0 +1,576 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "library.h"
+#include <stdint.h>
+#include <limits.h>
+
+// Packed catalog: books.txt with each author stored once in a dictionary
+// and each book a small record referring to it, compressed in independent
+// blocks. It is only a faster way to load books.txt - the header records the
+// size, modification time and inode of the books.txt it was built from, and
+// any other books.txt is parsed as text instead.
+//
+// Layout, integers in native byte order (checked with byte_order):
+//   PackHeader
+//   book blocks:   per book, varint zigzag(id - previous id), varint author
+//                  index, then the title NUL-terminated
+//   author blocks: the author names in index order, NUL-terminated
+// Each block is a PackBlockHeader and the compressed bytes, and unpacks to
+// at most PACK_BLOCK_SIZE bytes. Records never straddle blocks, so blocks
+// are decoded one at a time with a fixed amount of memory.
+
+#define PACK_MAGIC "LIBPACK1"
+#define PACK_BYTE_ORDER 0x01020304u
+#define PACK_BLOCK_SIZE 65536
+#define PACK_RECORD_MAX (10 + 5 + MAX_STRING)   // largest book or author record
+#define PACK_MIN_MATCH 4
+#define PACK_HASH_BITS 12
+
+// Start of the file
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t source_size;
+    int64_t source_mtime;
+    int64_t source_mtime_nsec;
+    uint64_t source_inode;
+    uint64_t authors_offset;    // file offset of the first author block
+    uint32_t book_count;
+    uint32_t author_count;
+    uint32_t book_blocks;
+    uint32_t author_blocks;
+} PackHeader;
+
+// Start of every block
+typedef struct {
+    uint32_t raw_length;
+    uint32_t packed_length;
+    uint32_t checksum;          // FNV-1a of the unpacked bytes
+    uint32_t reserved;
+} PackBlockHeader;
+
+struct BookPackWriter {
+    FILE *file;
+    PackHeader header;
+    uint64_t offset;            // bytes written so far
+    unsigned char *raw;         // block being filled
+    size_t raw_length;
+    unsigned char *packed;      // compressed block
+    char *authors;              // names in index order, NUL-terminated
+    size_t authors_length;
+    size_t authors_capacity;
+    uint32_t *author_offsets;   // index -> offset in authors
+    uint32_t author_capacity;
+    uint32_t *slots;            // name hash -> index + 1, 0 if free
+    uint32_t slot_count;        // power of two
+    int64_t previous_id;
+    int failed;
+};
+
+// Largest compressed size of a block of length bytes
+static size_t packBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+// FNV-1a hash of an author name
+static uint32_t hashName(const char *name) {
+    uint32_t hash = 2166136261u;
+
+    while (*name != '\0') {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Checksum of a block, so a damaged pack is parsed as text instead of
+// loading wrong titles. FNV-1a over 32-bit words, then the last bytes
+static uint32_t checksumBlock(const unsigned char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i + 4 <= length; i += 4) {
+        uint32_t word;
+
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 16777619u;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Append a run length continued in 255-valued bytes
+static size_t putLength(unsigned char *dst, size_t out, size_t length) {
+    while (length >= 255) {
+        dst[out++] = 255;
+        length -= 255;
+    }
+    dst[out++] = (unsigned char)length;
+    return out;
+}
+
+// Append one sequence: literals, then a match of match_length bytes
+// offset back (match_length 0 for the final, literal-only sequence)
+static size_t putSequence(unsigned char *dst, size_t out, const unsigned char *literals,
+                          size_t literal_length, size_t offset, size_t match_length) {
+    size_t match_code = match_length > 0 ? match_length - PACK_MIN_MATCH : 0;
+    unsigned char token = (unsigned char)((literal_length < 15 ? literal_length : 15) << 4 |
+                                          (match_code < 15 ? match_code : 15));
+
+    dst[out++] = token;
+    if (literal_length >= 15) {
+        out = putLength(dst, out, literal_length - 15);
+    }
+    memcpy(dst + out, literals, literal_length);
+    out += literal_length;
+    if (match_length > 0) {
+        dst[out++] = (unsigned char)(offset & 0xFF);
+        dst[out++] = (unsigned char)(offset >> 8);
+        if (match_code >= 15) {
+            out = putLength(dst, out, match_code - 15);
+        }
+    }
+    return out;
+}
+
+// Compress a block with LZ77: repeats of 4 or more bytes up to 65535 bytes
+// back become (offset, length) pairs, found through a hash of the next 4
+// bytes. Same sequence layout as LZ4. dst needs packBound(length) bytes
+static size_t compressBlock(const unsigned char *src, size_t length, unsigned char *dst) {
+    long table[1 << PACK_HASH_BITS];
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t out = 0;
+    int i;
+
+    for (i = 0; i < (1 << PACK_HASH_BITS); i++) {
+        table[i] = -1;
+    }
+
+    while (pos + PACK_MIN_MATCH <= length) {
+        uint32_t sequence;
+        uint32_t hash;
+        long candidate;
+
+        memcpy(&sequence, src + pos, sizeof(sequence));
+        hash = (sequence * 2654435761u) >> (32 - PACK_HASH_BITS);
+        candidate = table[hash];
+        table[hash] = (long)pos;
+
+        if (candidate >= 0 && pos - (size_t)candidate <= 65535 &&
+            memcmp(src + candidate, src + pos, PACK_MIN_MATCH) == 0) {
+            size_t match = PACK_MIN_MATCH;
+
+            while (pos + match < length && src[candidate + match] == src[pos + match]) {
+                match++;
+            }
+            out = putSequence(dst, out, src + anchor, pos - anchor, pos - (size_t)candidate, match);
+            pos += match;
+            anchor = pos;
+        } else {
+            pos++;
+        }
+    }
+    return putSequence(dst, out, src + anchor, length - anchor, 0, 0);
+}
+
+// Read a run length continued in 255-valued bytes. Returns 0 past the end
+static int getLength(const unsigned char *src, size_t length, size_t *in, size_t *value) {
+    unsigned char byte;
+
+    do {
+        if (*in >= length) {
+            return 0;
+        }
+        byte = src[(*in)++];
+        *value += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+// Decompress a block into at most capacity bytes. Returns the unpacked
+// length, or -1 if the block is corrupt
+static long decompressBlock(const unsigned char *src, size_t length, unsigned char *dst, size_t capacity) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length) {
+        unsigned char token = src[in++];
+        size_t literal_length = token >> 4;
+        size_t match_length = token & 15;
+        size_t offset;
+
+        if (literal_length == 15 && !getLength(src, length, &in, &literal_length)) {
+            return -1;
+        }
+        if (literal_length > length - in || literal_length > capacity - out) {
+            return -1;
+        }
+        memcpy(dst + out, src + in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        // The final sequence has no match
+        if (in == length) {
+            break;
+        }
+        if (length - in < 2) {
+            return -1;
+        }
+        offset = src[in] | (size_t)src[in + 1] << 8;
+        in += 2;
+        if (match_length == 15 && !getLength(src, length, &in, &match_length)) {
+            return -1;
+        }
+        match_length += PACK_MIN_MATCH;
+        if (offset == 0 || offset > out || match_length > capacity - out) {
+            return -1;
+        }
+        // Byte by byte: the match may overlap what it produces
+        for (; match_length > 0; match_length--, out++) {
+            dst[out] = dst[out - offset];
+        }
+    }
+    return (long)out;
+}
+
+// Append a varint: 7 bits per byte, low bits first
+static size_t putVarint(unsigned char *dst, size_t out, uint64_t value) {
+    while (value >= 0x80) {
+        dst[out++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    dst[out++] = (unsigned char)value;
+    return out;
+}
+
+// Read a varint. Returns 0 if it runs past the end
+static int getVarint(const unsigned char *src, size_t length, size_t *in, uint64_t *value) {
+    int shift;
+
+    *value = 0;
+    for (shift = 0; shift < 64 && *in < length; shift += 7) {
+        unsigned char byte = src[(*in)++];
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Compress and write the block being filled, if any
+static int flushPackBlock(BookPackWriter *writer, uint32_t *block_count) {
+    PackBlockHeader block;
+
+    if (writer->raw_length == 0) {
+        return 1;
+    }
+    block.raw_length = (uint32_t)writer->raw_length;
+    block.packed_length = (uint32_t)compressBlock(writer->raw, writer->raw_length, writer->packed);
+    block.checksum = checksumBlock(writer->raw, writer->raw_length);
+    block.reserved = 0;
+    if (fwrite(&block, sizeof(block), 1, writer->file) != 1 ||
+        fwrite(writer->packed, 1, block.packed_length, writer->file) != block.packed_length) {
+        return 0;
+    }
+    writer->offset += sizeof(block) + block.packed_length;
+    writer->raw_length = 0;
+    (*block_count)++;
+    return 1;
+}
+
+// Add a record to the block being filled, starting a new block if it
+// doesn't fit
+static int addPackRecord(BookPackWriter *writer, const unsigned char *record, size_t length,
+                         uint32_t *block_count) {
+    if (writer->raw_length + length > PACK_BLOCK_SIZE && !flushPackBlock(writer, block_count)) {
+        return 0;
+    }
+    memcpy(writer->raw + writer->raw_length, record, length);
+    writer->raw_length += length;
+    return 1;
+}
+
+// Double the author hash table
+static int growAuthorSlots(BookPackWriter *writer) {
+    uint32_t count = writer->slot_count > 0 ? writer->slot_count * 2 : 1024;
+    uint32_t *slots = calloc(count, sizeof(uint32_t));
+    uint32_t i;
+
+    if (slots == NULL) {
+        return 0;
+    }
+    for (i = 0; i < writer->header.author_count; i++) {
+        uint32_t slot = hashName(writer->authors + writer->author_offsets[i]) & (count - 1);
+
+        while (slots[slot] != 0) slot = (slot + 1) & (count - 1);
+        slots[slot] = i + 1;
+    }
+    free(writer->slots);
+    writer->slots = slots;
+    writer->slot_count = count;
+    return 1;
+}
+
+// Index of an author in the dictionary, adding it the first time.
+// Returns 0 if out of memory
+static int internAuthor(BookPackWriter *writer, const char *author, uint32_t *index) {
+    size_t length = strlen(author) + 1;
+    uint32_t slot;
+
+    if (writer->header.author_count >= writer->slot_count / 2 && !growAuthorSlots(writer)) {
+        return 0;
+    }
+    slot = hashName(author) & (writer->slot_count - 1);
+    while (writer->slots[slot] != 0) {
+        if (strcmp(writer->authors + writer->author_offsets[writer->slots[slot] - 1], author) == 0) {
+            *index = writer->slots[slot] - 1;
+            return 1;
+        }
+        slot = (slot + 1) & (writer->slot_count - 1);
+    }
+
+    if (writer->header.author_count == writer->author_capacity) {
+        uint32_t capacity = writer->author_capacity > 0 ? writer->author_capacity * 2 : 256;
+        uint32_t *offsets = capacity > writer->author_capacity ?
+                            realloc(writer->author_offsets, sizeof(uint32_t) * capacity) : NULL;
+
+        if (offsets == NULL) {
+            return 0;
+        }
+        writer->author_offsets = offsets;
+        writer->author_capacity = capacity;
+    }
+    if (writer->authors_capacity - writer->authors_length < length) {
+        size_t capacity = writer->authors_capacity > 0 ? writer->authors_capacity * 2 : 4096;
+        char *authors;
+
+        while (capacity - writer->authors_length < length) capacity *= 2;
+        if (capacity > UINT32_MAX || (authors = realloc(writer->authors, capacity)) == NULL) {
+            return 0;
+        }
+        writer->authors = authors;
+        writer->authors_capacity = capacity;
+    }
+
+    *index = writer->header.author_count++;
+    writer->author_offsets[*index] = (uint32_t)writer->authors_length;
+    memcpy(writer->authors + writer->authors_length, author, length);
+    writer->authors_length += length;
+    writer->slots[slot] = *index + 1;
+    return 1;
+}
+
+// Free a writer and close its file. Returns 0 if the file failed to close
+static int freePackWriter(BookPackWriter *writer) {
+    int ok = fclose(writer->file) == 0;
+
+    free(writer->raw);
+    free(writer->packed);
+    free(writer->authors);
+    free(writer->author_offsets);
+    free(writer->slots);
+    free(writer);
+    return ok;
+}
+
+// Create a packed catalog at path. Books are added in books.txt order
+BookPackWriter *packCreate(const char *path) {
+    BookPackWriter *writer = calloc(1, sizeof(BookPackWriter));
+
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        free(writer);
+        return NULL;
+    }
+    writer->raw = malloc(PACK_BLOCK_SIZE);
+    writer->packed = malloc(packBound(PACK_BLOCK_SIZE));
+    memcpy(writer->header.magic, PACK_MAGIC, sizeof(writer->header.magic));
+    writer->header.byte_order = PACK_BYTE_ORDER;
+
+    // The header is written again with the counts by packFinish
+    if (writer->raw == NULL || writer->packed == NULL ||
+        fwrite(&writer->header, sizeof(PackHeader), 1, writer->file) != 1) {
+        freePackWriter(writer);
+        return NULL;
+    }
+    writer->offset = sizeof(PackHeader);
+    return writer;
+}
+
+// Add one book. Returns 0 on failure, after which packFinish fails too
+int packAddBook(BookPackWriter *writer, int id, const char *title, const char *author) {
+    unsigned char record[PACK_RECORD_MAX];
+    int64_t delta = (int64_t)id - writer->previous_id;
+    size_t title_length = strlen(title);
+    size_t length;
+    uint32_t index;
+
+    if (writer->failed) {
+        return 0;
+    }
+    if (title_length > MAX_STRING - 1 || strlen(author) > MAX_STRING - 1 ||
+        writer->header.book_count == UINT32_MAX || !internAuthor(writer, author, &index)) {
+        writer->failed = 1;
+        return 0;
+    }
+
+    length = putVarint(record, 0, delta >= 0 ? (uint64_t)delta << 1 : ((uint64_t)-(delta + 1) << 1) | 1);
+    length = putVarint(record, length, index);
+    memcpy(record + length, title, title_length + 1);
+    length += title_length + 1;
+    if (!addPackRecord(writer, record, length, &writer->header.book_blocks)) {
+        writer->failed = 1;
+        return 0;
+    }
+    writer->previous_id = id;
+    writer->header.book_count++;
+    return 1;
+}
+
+// Write the author dictionary and the header, recording the books.txt the
+// books came from, and free the writer. Returns 1 if the file is complete
+int packFinish(BookPackWriter *writer, const PackSource *source) {
+    int ok = !writer->failed && flushPackBlock(writer, &writer->header.book_blocks);
+    uint32_t i;
+
+    writer->header.authors_offset = writer->offset;
+    for (i = 0; ok && i < writer->header.author_count; i++) {
+        const char *author = writer->authors + writer->author_offsets[i];
+        ok = addPackRecord(writer, (const unsigned char *)author, strlen(author) + 1,
+                           &writer->header.author_blocks);
+    }
+    ok = ok && flushPackBlock(writer, &writer->header.author_blocks);
+
+    writer->header.source_size = source->size;
+    writer->header.source_mtime = source->mtime;
+    writer->header.source_mtime_nsec = source->mtime_nsec;
+    writer->header.source_inode = source->inode;
+    ok = ok && fseek(writer->file, 0, SEEK_SET) == 0 &&
+         fwrite(&writer->header, sizeof(PackHeader), 1, writer->file) == 1 &&
+         fflush(writer->file) == 0;
+    return freePackWriter(writer) && ok;
+}
+
+// Read and unpack the next block into raw. Returns its length or -1
+static long readPackBlock(FILE *file, unsigned char *packed, unsigned char *raw) {
+    PackBlockHeader block;
+
+    if (fread(&block, sizeof(block), 1, file) != 1 ||
+        block.raw_length > PACK_BLOCK_SIZE || block.packed_length > packBound(PACK_BLOCK_SIZE) ||
+        fread(packed, 1, block.packed_length, file) != block.packed_length) {
+        return -1;
+    }
+    if (decompressBlock(packed, block.packed_length, raw, PACK_BLOCK_SIZE) != (long)block.raw_length ||
+        checksumBlock(raw, block.raw_length) != block.checksum) {
+        return -1;
+    }
+    return (long)block.raw_length;
+}
+
+// Hand the author dictionary to the visitor
+static int visitPackAuthors(FILE *file, const PackHeader *header, unsigned char *packed,
+                            unsigned char *raw, const PackVisitor *visitor) {
+    uint32_t authors = 0;
+    uint32_t i;
+
+    for (i = 0; i < header->author_blocks; i++) {
+        long length = readPackBlock(file, packed, raw);
+        size_t in = 0;
+
+        if (length < 0) {
+            return 0;
+        }
+        while (in < (size_t)length) {
+            const char *name = (const char *)raw + in;
+            const unsigned char *end = memchr(raw + in, '\0', (size_t)length - in);
+
+            if (end == NULL || authors == header->author_count || !visitor->author(name, visitor->context)) {
+                return 0;
+            }
+            in = (size_t)(end - raw) + 1;
+            authors++;
+        }
+    }
+    return authors == header->author_count;
+}
+
+// Hand the books to the visitor
+static int visitPackBooks(FILE *file, const PackHeader *header, unsigned char *packed,
+                          unsigned char *raw, const PackVisitor *visitor) {
+    int64_t id = 0;
+    uint32_t books = 0;
+    uint32_t i;
+
+    for (i = 0; i < header->book_blocks; i++) {
+        long length = readPackBlock(file, packed, raw);
+        size_t in = 0;
+
+        if (length < 0) {
+            return 0;
+        }
+        while (in < (size_t)length) {
+            uint64_t delta, author;
+            const unsigned char *end;
+
+            if (!getVarint(raw, (size_t)length, &in, &delta) ||
+                !getVarint(raw, (size_t)length, &in, &author) || author >= header->author_count ||
+                (end = memchr(raw + in, '\0', (size_t)length - in)) == NULL) {
+                return 0;
+            }
+            id += (delta & 1) ? -(int64_t)(delta >> 1) - 1 : (int64_t)(delta >> 1);
+            if (id < INT_MIN || id > INT_MAX || books == header->book_count ||
+                !visitor->book((int)id, (const char *)raw + in, (unsigned long)author, visitor->context)) {
+                return 0;
+            }
+            in = (size_t)(end - raw) + 1;
+            books++;
+        }
+    }
+    return books == header->book_count;
+}
+
+// Load a packed catalog built from source: the visitor gets the counts,
+// then every author, then every book in books.txt order. Returns 0 if the
+// file is missing, corrupt, from another machine's byte order or built
+// from a different books.txt, or if a visitor callback failed
+int packLoad(const char *path, const PackSource *source, const PackVisitor *visitor) {
+    FILE *file = fopen(path, "rb");
+    PackHeader header;
+    unsigned char *packed;
+    unsigned char *raw;
+    int ok;
+
+    if (file == NULL) {
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byte_order != PACK_BYTE_ORDER ||
+        header.source_size != source->size || header.source_mtime != source->mtime ||
+        header.source_mtime_nsec != source->mtime_nsec || header.source_inode != source->inode) {
+        fclose(file);
+        return 0;
+    }
+
+    packed = malloc(packBound(PACK_BLOCK_SIZE));
+    raw = malloc(PACK_BLOCK_SIZE);
+    ok = packed != NULL && raw != NULL && header.authors_offset <= LONG_MAX &&
+         visitor->start(header.book_count, header.author_count, visitor->context) &&
+         fseek(file, (long)header.authors_offset, SEEK_SET) == 0 &&
+         visitPackAuthors(file, &header, packed, raw, visitor) &&
+         fseek(file, sizeof(PackHeader), SEEK_SET) == 0 &&
+         visitPackBooks(file, &header, packed, raw, visitor);
+
+    free(packed);
+    free(raw);
+    fclose(file);
+    return ok;
+}
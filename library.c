@@ -1,6 +1,70 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "library.h"
+#include <sys/stat.h>
+#include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Paged catalog, open when catalog.db exists
+static PagedStore *paged_catalog = NULL;
+
+// Look up a user in users.txt (defined with the file caches below)
+static int findUser(const char *username, const char *password);
+
+#ifndef _WIN32
+// Open library.lock, -1 until the first update
+static int lock_fd = -1;
+#endif
+
+// Take the lock on the text data files. Borrowing, returning and registering
+// check the files and then rewrite or append to them, and another library
+// process doing the same in between would lose an update. Not available on
+// Windows. Returns 0 if the lock can't be taken
+static int lockDataFiles() {
+#ifndef _WIN32
+    struct flock lock;
+    
+    if (lock_fd < 0) {
+        lock_fd = open(LOCK_FILE, O_RDWR | O_CREAT, 0644);
+        if (lock_fd < 0) {
+            return 0;
+        }
+    }
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(lock_fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+#endif
+    return 1;
+}
 
-// Global variables (removed unused variable)
+// Release the lock taken by lockDataFiles
+static void unlockDataFiles() {
+#ifndef _WIN32
+    struct flock lock;
+    
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_UNLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(lock_fd, F_SETLK, &lock);
+#endif
+}
 
 // Clear input buffer - clears any leftover characters
 void clearInputBuffer() {
@@ -58,21 +122,24 @@ void trimString(char *str) {
     str[i] = '\0';
 }
 
-// Parse semicolon-separated values (portable alternative to strtok_r)
-static void parseField(char *line, int field_num, char *output) {
+// Parse semicolon-separated values (portable alternative to strtok_r).
+// Fields longer than size - 1 characters are truncated
+static void parseField(char *line, int field_num, char *output, size_t size) {
     int i = 0;
     int current_field = 0;
     int start = 0;
     int len = strlen(line);
     
-    for (i = 0; i < len; i++) {
-        if (line[i] == ';' || line[i] == '\n' || line[i] == '\r') {
+    for (i = 0; i <= len; i++) {
+        if (i == len || line[i] == ';' || line[i] == '\n' || line[i] == '\r') {
             if (current_field == field_num) {
-                int j;
-                for (j = start; j < i; j++) {
-                    output[j - start] = line[j];
+                size_t length = (size_t)(i - start);
+                
+                if (length > size - 1) {
+                    length = size - 1;
                 }
-                output[j - start] = '\0';
+                memcpy(output, line + start, length);
+                output[length] = '\0';
                 return;
             }
             start = i + 1;
@@ -80,24 +147,13 @@ static void parseField(char *line, int field_num, char *output) {
         }
     }
     
-    // Handle last field
-    if (current_field == field_num) {
-        int j;
-        for (j = start; j < len; j++) {
-            output[j - start] = line[j];
-        }
-        output[len - start] = '\0';
-    } else {
-        output[0] = '\0';
-    }
+    output[0] = '\0';
 }
 
 // Register a new user
 int registerUser() {
     User new_user;
     FILE *file;
-    User existing_user;
-    int user_exists = 0;
     
     printf("=== User Registration ===\nEnter username: ");
     fflush(stdout);
@@ -112,18 +168,7 @@ int registerUser() {
     }
     
     // Check if user already exists
-    file = fopen(USERS_FILE, "r");
-    if (file != NULL) {
-        while (fscanf(file, "%s %s", existing_user.username, existing_user.password) == 2) {
-            if (strcmp(existing_user.username, new_user.username) == 0) {
-                user_exists = 1;
-                break;
-            }
-        }
-        fclose(file);
-    }
-    
-    if (user_exists) {
+    if (findUser(new_user.username, NULL) == 1) {
         printf("Error: Username already exists!\n");
         return 0;
     }
@@ -140,15 +185,27 @@ int registerUser() {
         return 0;
     }
     
-    // Save user to file
+    // Save user to file, checking again under the lock in case another
+    // process registered the same name meanwhile
+    if (!lockDataFiles()) {
+        printf("Error: Cannot lock %s!\n", LOCK_FILE);
+        return 0;
+    }
+    if (findUser(new_user.username, NULL) == 1) {
+        unlockDataFiles();
+        printf("Error: Username already exists!\n");
+        return 0;
+    }
     file = fopen(USERS_FILE, "a");
     if (file == NULL) {
+        unlockDataFiles();
         printf("Error: Cannot open users file for writing!\n");
         return 0;
     }
     
     fprintf(file, "%s %s\n", new_user.username, new_user.password);
     fclose(file);
+    unlockDataFiles();
     
     printf("Registration successful!\n");
     return 1;
@@ -158,8 +215,7 @@ int registerUser() {
 int loginUser(char *username) {
     char input_username[MAX_STRING];
     char input_password[MAX_STRING];
-    User user;
-    FILE *file;
+    int found;
     
     printf("=== User Login ===\nEnter username: ");
     fflush(stdout);
@@ -178,23 +234,18 @@ int loginUser(char *username) {
     }
     trimString(input_password);
     
-    file = fopen(USERS_FILE, "r");
-    if (file == NULL) {
+    found = findUser(input_username, input_password);
+    if (found < 0) {
         printf("Error: Cannot open users file!\n");
         return 0;
     }
     
-    while (fscanf(file, "%s %s", user.username, user.password) == 2) {
-        if (strcmp(user.username, input_username) == 0 && 
-            strcmp(user.password, input_password) == 0) {
-            strcpy(username, input_username);
-            fclose(file);
-            printf("Login successful! Welcome, %s!\n", username);
-            return 1;
-        }
+    if (found) {
+        strcpy(username, input_username);
+        printf("Login successful! Welcome, %s!\n", username);
+        return 1;
     }
     
-    fclose(file);
     printf("Error: Invalid username or password!\n");
     return 0;
 }
@@ -246,302 +297,2138 @@ void displayAuthMenu() {
     fflush(stdout);
 }
 
-// Load all books from books.txt
-int loadBooks(Book books[], int max_books) {
-    FILE *file = fopen(BOOKS_FILE, "r");
-    int count = 0;
-    char line[MAX_STRING * 3];
+// Hash table slot of a string pool
+typedef struct {
+    uint32_t offset;        // offset + 1 of the string, 0 if the slot is free
+    uint32_t hash;          // kept so growing the table needs no rehashing
+} PoolSlot;
+
+// Strings of a parsed file, stored back to back and referred to by offset.
+// While a file is parsed from the start, a hash table keeps each distinct
+// interned string (an author with many books) stored only once
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    PoolSlot *slots;        // NULL when not deduplicating
+    uint32_t slot_count;    // power of two
+    uint32_t used;
+} StringPool;
+
+// FNV-1a hash of a string
+static uint32_t hashString(const char *text) {
+    uint32_t hash = 2166136261u;
     
-    if (file == NULL) {
-        return 0;
+    while (*text != '\0') {
+        hash = (hash ^ (unsigned char)*text++) * 16777619u;
     }
-    
-    while (fgets(line, sizeof(line), file) != NULL && count < max_books) {
-        // Format: id;title;author
-        char field[MAX_STRING];
-        
-        parseField(line, 0, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        books[count].id = atoi(field);
-        
-        parseField(line, 1, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(books[count].title, field);
-        
-        parseField(line, 2, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(books[count].author, field);
-        
-        count++;
+    return hash;
+}
+
+// Stop deduplicating and free the hash table
+static void poolDropIndex(StringPool *pool) {
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->slot_count = 0;
+    pool->used = 0;
+}
+
+// Deduplicate strings added from now on. Without memory for the hash
+// table strings are just not deduplicated
+static void poolStartIndex(StringPool *pool) {
+    poolDropIndex(pool);
+    pool->slots = calloc(1024, sizeof(PoolSlot));
+    pool->slot_count = pool->slots != NULL ? 1024 : 0;
+}
+
+// Double the hash table, or stop deduplicating if that fails
+static void poolGrowIndex(StringPool *pool) {
+    uint32_t count = pool->slot_count * 2;
+    PoolSlot *slots = count > pool->slot_count ? calloc(count, sizeof(PoolSlot)) : NULL;
+    uint32_t i;
+    
+    if (slots == NULL) {
+        poolDropIndex(pool);
+        return;
     }
-    
-    fclose(file);
-    return count;
+    for (i = 0; i < pool->slot_count; i++) {
+        if (pool->slots[i].offset != 0) {
+            uint32_t slot = pool->slots[i].hash & (count - 1);
+            
+            while (slots[slot].offset != 0) slot = (slot + 1) & (count - 1);
+            slots[slot] = pool->slots[i];
+        }
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_count = count;
 }
 
-// Load available books from available_books.txt
-int loadAvailableBooks(Book books[], int max_books) {
-    FILE *file = fopen(AVAILABLE_BOOKS_FILE, "r");
-    int count = 0;
-    char line[MAX_STRING * 3];
+// Make room for length more bytes. Offsets must fit in 32 bits
+static int poolReserve(StringPool *pool, size_t length) {
+    size_t capacity = pool->capacity > 0 ? pool->capacity : 4096;
+    char *data;
     
-    if (file == NULL) {
+    if (length > UINT32_MAX - 1 - pool->length) {
         return 0;
     }
-    
-    while (fgets(line, sizeof(line), file) != NULL && count < max_books) {
-        char field[MAX_STRING];
-        
-        parseField(line, 0, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        books[count].id = atoi(field);
-        
-        parseField(line, 1, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(books[count].title, field);
-        
-        parseField(line, 2, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(books[count].author, field);
-        
-        count++;
+    if (pool->capacity - pool->length >= length) {
+        return 1;
     }
-    
-    fclose(file);
-    return count;
+    while (capacity - pool->length < length) {
+        capacity = capacity <= UINT32_MAX / 2 ? capacity * 2 : UINT32_MAX;
+    }
+    data = realloc(pool->data, capacity);
+    if (data == NULL) {
+        return 0;
+    }
+    pool->data = data;
+    pool->capacity = capacity;
+    return 1;
 }
 
-// Save available books to file
-int saveAvailableBooks(Book books[], int count) {
-    FILE *file = fopen(AVAILABLE_BOOKS_FILE, "w");
-    int i;
+// Store a string and set *offset to it. Returns 0 if out of memory
+static int poolAdd(StringPool *pool, const char *text, uint32_t *offset) {
+    size_t length = strlen(text) + 1;
     
-    if (file == NULL) {
+    if (!poolReserve(pool, length)) {
         return 0;
     }
-    
-    for (i = 0; i < count; i++) {
-        fprintf(file, "%d;%s;%s\n", books[i].id, books[i].title, books[i].author);
+    *offset = (uint32_t)pool->length;
+    memcpy(pool->data + pool->length, text, length);
+    pool->length += length;
+    return 1;
+}
+
+// Like poolAdd, but while deduplicating an interned copy of the string is
+// reused. For strings that repeat: hashing unique ones costs more than it saves
+static int poolIntern(StringPool *pool, const char *text, uint32_t *offset) {
+    uint32_t hash;
+    uint32_t slot;
+    
+    if (pool->slots == NULL) {
+        return poolAdd(pool, text, offset);
+    }
+    hash = hashString(text);
+    slot = hash & (pool->slot_count - 1);
+    while (pool->slots[slot].offset != 0) {
+        if (pool->slots[slot].hash == hash &&
+            strcmp(pool->data + pool->slots[slot].offset - 1, text) == 0) {
+            *offset = pool->slots[slot].offset - 1;
+            return 1;
+        }
+        slot = (slot + 1) & (pool->slot_count - 1);
+    }
+    if (!poolAdd(pool, text, offset)) {
+        return 0;
     }
     
-    fclose(file);
+    pool->slots[slot].offset = *offset + 1;
+    pool->slots[slot].hash = hash;
+    pool->used++;
+    if (pool->used > pool->slot_count / 2) {
+        poolGrowIndex(pool);
+    }
     return 1;
 }
 
-// Load borrowed books from borrowed_books.txt
-int loadBorrowedBooks(BorrowedBook borrowed[], int max_borrowed) {
-    FILE *file = fopen(BORROWED_BOOKS_FILE, "r");
-    int count = 0;
-    char line[MAX_STRING * 4];
-    
-    if (file == NULL) {
+// Append all strings of src to dst; *base is then added to src offsets.
+// Strings already in dst are not looked for, so dst stops deduplicating
+static int poolAppend(StringPool *dst, const StringPool *src, uint32_t *base) {
+    if (!poolReserve(dst, src->length)) {
         return 0;
     }
+    poolDropIndex(dst);
+    *base = (uint32_t)dst->length;
+    if (src->length > 0) {
+        memcpy(dst->data + dst->length, src->data, src->length);
+    }
+    dst->length += src->length;
+    return 1;
+}
+
+// Empty a pool, keeping its buffer for the next parse
+static void poolClear(StringPool *pool) {
+    pool->length = 0;
+    poolDropIndex(pool);
+}
+
+// Free everything a pool holds
+static void poolFree(StringPool *pool) {
+    poolDropIndex(pool);
+    free(pool->data);
+    pool->data = NULL;
+    pool->length = 0;
+    pool->capacity = 0;
+}
+
+// String stored at offset
+static const char *poolString(const StringPool *pool, uint32_t offset) {
+    return pool->data + offset;
+}
+
+// Cached users.txt row; strings are offsets into the cache's string pool
+typedef struct {
+    uint32_t username;
+    uint32_t password;
+} UserRow;
+
+// Cached books.txt row
+typedef struct {
+    int id;
+    uint32_t title;
+    uint32_t author;
+} CatalogRow;
+
+// Cached borrowed_books.txt row. Titles are looked up in the catalog
+typedef struct {
+    uint32_t username;
+    int book_id;
+} LoanRow;
+
+// Cached available_books.txt rows are just the book IDs (int)
+
+// Split a line in place at semicolons into at most max fields, trimmed and
+// cut at MAX_STRING - 1 characters like parseField does. The line ends at
+// its first newline. Returns the number of fields
+static int splitFields(char *line, char *fields[], int max) {
+    char *field = line;
+    int count = 0;
     
-    while (fgets(line, sizeof(line), file) != NULL && count < max_borrowed) {
-        // Format: username;book_id;title;author
-        char field[MAX_STRING];
-        
-        parseField(line, 0, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(borrowed[count].username, field);
-        
-        parseField(line, 1, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        borrowed[count].book_id = atoi(field);
-        
-        parseField(line, 2, field);
-        trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(borrowed[count].title, field);
+    while (count < max) {
+        char *end = field + strcspn(field, ";\r\n");
+        char stop = *end;
         
-        parseField(line, 3, field);
+        *end = '\0';
         trimString(field);
-        if (strlen(field) == 0) continue;
-        strcpy(borrowed[count].author, field);
-        
-        count++;
+        if (strlen(field) > MAX_STRING - 1) {
+            field[MAX_STRING - 1] = '\0';
+        }
+        fields[count++] = field;
+        if (stop != ';') {
+            break;
+        }
+        field = end + 1;
     }
-    
-    fclose(file);
     return count;
 }
 
-// Save borrowed books to file
-int saveBorrowedBooks(BorrowedBook borrowed[], int count) {
-    FILE *file = fopen(BORROWED_BOOKS_FILE, "w");
-    int i;
-    
-    if (file == NULL) {
-        return 0;
-    }
-    
-    for (i = 0; i < count; i++) {
-        fprintf(file, "%s;%d;%s;%s\n", 
-                borrowed[i].username, 
-                borrowed[i].book_id, 
-                borrowed[i].title, 
-                borrowed[i].author);
-    }
+// Split one books.txt line into id, title and author. Format: id;title;author
+static int splitBookLine(char *line, char *fields[3]) {
+    return splitFields(line, fields, 3) == 3 &&
+           fields[0][0] != '\0' && fields[1][0] != '\0' && fields[2][0] != '\0';
+}
+
+// Split one borrowed_books.txt line into username and book ID.
+// Format: username;book_id (older files: username;book_id;title;author)
+static int splitLoanLine(char *line, char *fields[2]) {
+    return splitFields(line, fields, 2) == 2 && fields[0][0] != '\0' && fields[1][0] != '\0';
+}
+
+// Parsers below return 1 for a row, 0 for a line to skip, -1 if out of memory
+
+// Parse one users.txt line. Format: username password
+static int parseUserLine(char *line, void *row, StringPool *strings) {
+    UserRow *user = (UserRow *)row;
+    char username[MAX_STRING];
+    char password[MAX_STRING];
     
-    fclose(file);
+    if (sscanf(line, "%255s %255s", username, password) != 2) return 0;
+    return poolAdd(strings, username, &user->username) &&
+           poolAdd(strings, password, &user->password) ? 1 : -1;
+}
+
+// Parse one books.txt line
+static int parseBookLine(char *line, void *row, StringPool *strings) {
+    CatalogRow *book = (CatalogRow *)row;
+    char *fields[3];
+    
+    if (!splitBookLine(line, fields)) return 0;
+    book->id = atoi(fields[0]);
+    return poolAdd(strings, fields[1], &book->title) &&
+           poolIntern(strings, fields[2], &book->author) ? 1 : -1;
+}
+
+// Parse one available_books.txt line. Format: id (older files: id;title;author,
+// where title and author are now taken from the catalog)
+static int parseAvailableLine(char *line, void *row, StringPool *strings) {
+    char *fields[1];
+    
+    (void)strings;
+    if (splitFields(line, fields, 1) != 1 || fields[0][0] == '\0') return 0;
+    *(int *)row = atoi(fields[0]);
     return 1;
 }
 
-// Initialize available_books.txt from books.txt if it doesn't exist
-void initializeAvailableBooks() {
-    FILE *available_file = fopen(AVAILABLE_BOOKS_FILE, "r");
-    if (available_file != NULL) {
-        fclose(available_file);
-        return; // File exists, no need to initialize
-    }
-    
-    // Copy books.txt to available_books.txt
-    FILE *books_file = fopen(BOOKS_FILE, "r");
-    if (books_file == NULL) {
-        return; // books.txt doesn't exist yet
-    }
+// Parse one borrowed_books.txt line
+static int parseBorrowedLine(char *line, void *row, StringPool *strings) {
+    LoanRow *loan = (LoanRow *)row;
+    char *fields[2];
+    
+    if (!splitLoanLine(line, fields)) return 0;
+    loan->book_id = atoi(fields[1]);
+    return poolIntern(strings, fields[0], &loan->username) ? 1 : -1;
+}
+
+// Move a row's string offsets by base when its pool is appended to another
+static void rebaseUserRow(void *row, uint32_t base) {
+    ((UserRow *)row)->username += base;
+    ((UserRow *)row)->password += base;
+}
+
+static void rebaseBookRow(void *row, uint32_t base) {
+    ((CatalogRow *)row)->title += base;
+    ((CatalogRow *)row)->author += base;
+}
+
+static void rebaseLoanRow(void *row, uint32_t base) {
+    ((LoanRow *)row)->username += base;
+}
+
+// Reads a file line by line in STREAM_BLOCK_SIZE blocks, keeping track of
+// the offset itself (ftell costs a system call per line). A line longer than
+// the line buffer is cut there and the rest of it skipped, so an overlong
+// row is read as one truncated row by every reader
+typedef struct {
+    FILE *file;
+    char *block;
+    size_t start;           // next unread byte in block
+    size_t filled;
+    long offset;            // file offset just past the last line returned
+    int complete;           // the last line returned ended with a newline
+    char line[MAX_STRING * 4];
+} LineReader;
+
+// Start reading at the current position of file, which is at offset.
+// Returns 0 if out of memory
+static int openLineReader(LineReader *reader, FILE *file, long offset) {
+    reader->file = file;
+    reader->block = malloc(STREAM_BLOCK_SIZE);
+    reader->start = 0;
+    reader->filled = 0;
+    reader->offset = offset;
+    reader->complete = 0;
+    return reader->block != NULL;
+}
+
+// Next line, NUL-terminated and with its newline if it fit. NULL at end of file
+static char *readLine(LineReader *reader) {
+    size_t length = 0;
+    int found = 0;
     
-    available_file = fopen(AVAILABLE_BOOKS_FILE, "w");
-    if (available_file == NULL) {
-        fclose(books_file);
-        return;
+    while (!found) {
+        char *next = reader->block + reader->start;
+        char *newline;
+        size_t chunk, take;
+        
+        if (reader->start == reader->filled) {
+            reader->filled = fread(reader->block, 1, STREAM_BLOCK_SIZE, reader->file);
+            reader->start = 0;
+            if (reader->filled == 0) break;
+            next = reader->block;
+        }
+        newline = memchr(next, '\n', reader->filled - reader->start);
+        chunk = newline != NULL ? (size_t)(newline - next) + 1 : reader->filled - reader->start;
+        take = sizeof(reader->line) - 1 - length;
+        if (take > chunk) take = chunk;
+        memcpy(reader->line + length, next, take);
+        length += take;
+        reader->start += chunk;
+        reader->offset += (long)chunk;
+        found = newline != NULL;
     }
     
-    char line[MAX_STRING * 3];
-    while (fgets(line, sizeof(line), books_file) != NULL) {
-        fputs(line, available_file);
+    if (length == 0 && !found) {
+        return NULL;
     }
-    
-    fclose(books_file);
-    fclose(available_file);
+    reader->line[length] = '\0';
+    reader->complete = found;
+    return reader->line;
 }
 
-// Display all books
-void displayAllBooks() {
-    Book books[MAX_BOOKS];
-    int count = loadBooks(books, MAX_BOOKS);
-    int i;
-    
-    printf("\n=== All Books ===\n");
-    if (count == 0) {
-        printf("No books found in the system.\n");
+static void closeLineReader(LineReader *reader) {
+    free(reader->block);
+}
+
+// Parsed contents of one data file. The rows stay valid while the file's
+// inode, size and modification time are unchanged; if the file only grew
+// and its old contents still match, just the appended lines are parsed.
+typedef struct FileCache {
+    const char *path;
+    int (*parse_line)(char *line, void *row, StringPool *strings);
+    void (*rebase_row)(void *row, uint32_t base);  // NULL if rows hold no strings
+    int (*load_packed)(struct FileCache *cache, FILE *file);  // NULL if there is no packed form
+    size_t row_size;
+    void *rows;
+    int capacity;           // rows allocated; grows with the file
+    int count;
+    StringPool strings;     // strings the rows refer to
+    int loaded;
+    int dirty;              // set by inotify or by our own saves
+    int exists;
+    unsigned long inode;
+    long size;
+    time_t mtime;
+    long mtime_nsec;
+    long parsed_bytes;      // offset just past the last complete line parsed
+    unsigned long version;  // bumped whenever rows change
+    unsigned long prefix_checksum;  // of the first parsed_bytes (see prefixChecksum)
+} FileCache;
+
+static int loadBookPack(FileCache *cache, FILE *file);
+
+static FileCache users_cache = {.path = USERS_FILE, .parse_line = parseUserLine,
+                                .rebase_row = rebaseUserRow, .row_size = sizeof(UserRow)};
+static FileCache books_cache = {.path = BOOKS_FILE, .parse_line = parseBookLine,
+                                .rebase_row = rebaseBookRow, .load_packed = loadBookPack,
+                                .row_size = sizeof(CatalogRow)};
+static FileCache available_cache = {.path = AVAILABLE_BOOKS_FILE, .parse_line = parseAvailableLine,
+                                    .rebase_row = NULL, .row_size = sizeof(int)};
+static FileCache borrowed_cache = {.path = BORROWED_BOOKS_FILE, .parse_line = parseBorrowedLine,
+                                   .rebase_row = rebaseLoanRow, .row_size = sizeof(LoanRow)};
+
+#ifdef __linux__
+// One inotify watch on the working directory covers all data files, and
+// also catches files that are replaced (editors that write and rename)
+static int inotify_fd = -2;     // -2: not initialized yet, -1: unavailable
+
+// Mark caches whose file changed since the last call
+static void pollFileEvents() {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    FileCache *caches[] = {&users_cache, &books_cache, &available_cache, &borrowed_cache};
+    ssize_t length;
+    
+    if (inotify_fd == -2) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd >= 0 &&
+            inotify_add_watch(inotify_fd, ".", IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE |
+                              IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB) < 0) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+        return;
+    }
+    if (inotify_fd < 0) {
         return;
     }
     
-    printf("%-5s %-40s %-30s\n", "ID", "Title", "Author");
-    printf("----------------------------------------------------------------------------\n");
-    for (i = 0; i < count; i++) {
-        printf("%-5d %-40s %-30s\n", books[i].id, books[i].title, books[i].author);
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        char *ptr = buffer;
+        while (ptr < buffer + length) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            size_t i;
+            
+            // Overflowed queue: we no longer know what changed
+            for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+                if ((event->mask & IN_Q_OVERFLOW) ||
+                    (event->len > 0 && strcmp(event->name, caches[i]->path) == 0)) {
+                    caches[i]->dirty = 1;
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
     }
-    printf("\n");
 }
+#endif
 
-// Display available books
-void displayAvailableBooks() {
-    Book books[MAX_BOOKS];
-    int count = loadAvailableBooks(books, MAX_BOOKS);
-    int i;
+// Make room for at least needed rows. Returns 0 if out of memory
+static int growCache(FileCache *cache, int needed) {
+    int capacity = cache->capacity > 0 ? cache->capacity : 256;
+    void *rows;
     
-    printf("\n=== Available Books ===\n");
-    if (count == 0) {
-        printf("No books available at the moment.\n");
-        return;
+    if (needed <= cache->capacity) {
+        return 1;
     }
-    
-    printf("%-5s %-40s %-30s\n", "ID", "Title", "Author");
-    printf("----------------------------------------------------------------------------\n");
-    for (i = 0; i < count; i++) {
-        printf("%-5d %-40s %-30s\n", books[i].id, books[i].title, books[i].author);
+    while (capacity < needed) {
+        capacity *= 2;
     }
-    printf("\n");
+    rows = realloc(cache->rows, cache->row_size * capacity);
+    if (rows == NULL) {
+        return 0;
+    }
+    cache->rows = rows;
+    cache->capacity = capacity;
+    return 1;
 }
 
-// Borrow a book
-void borrowBook(const char *username) {
-    Book available_books[MAX_BOOKS];
-    BorrowedBook borrowed[MAX_BORROWED];
-    int available_count, borrowed_count;
-    int book_id, i, j;
-    int found = 0;
-    
-    printf("\n=== Borrow a Book ===\n");
-    displayAvailableBooks();
+// Parse lines from offset (the current position of file) into cache rows
+static void parseIntoCache(FileCache *cache, FILE *file, long offset) {
+    LineReader reader;
+    char *line;
     
-    printf("Enter book ID to borrow: ");
-    fflush(stdout);
-    book_id = getIntInput();
+    if (!openLineReader(&reader, file, offset)) {
+        cache->parsed_bytes = -1;
+        return;
+    }
+    while ((line = readLine(&reader)) != NULL) {
+        void *row;
+        int parsed;
+        
+        // Out of memory: keep what we have, reparse fully next time
+        if (!growCache(cache, cache->count + 1)) {
+            cache->parsed_bytes = -1;
+            break;
+        }
+        row = (char *)cache->rows + cache->row_size * cache->count;
+        parsed = cache->parse_line(line, row, &cache->strings);
+        if (parsed < 0) {
+            cache->parsed_bytes = -1;
+            break;
+        }
+        if (parsed > 0) {
+            cache->count++;
+        }
+        // A line without newline may still be in the middle of being written,
+        // so the next append can't be parsed on its own
+        if (reader.complete) {
+            cache->parsed_bytes = reader.offset;
+        } else {
+            cache->parsed_bytes = -1;
+            break;
+        }
+    }
+    closeLineReader(&reader);
+}
+
+static void reloadCache(FileCache *cache);
+
+// FNV-1a checksum of bytes [start, end) of a file
+static unsigned long checksumRange(FILE *file, long start, long end, unsigned long hash) {
+    unsigned char buffer[4096];
+    
+    if (fseek(file, start, SEEK_SET) != 0) {
+        return 0;
+    }
+    while (start < end) {
+        size_t want = end - start < (long)sizeof(buffer) ? (size_t)(end - start) : sizeof(buffer);
+        size_t n = fread(buffer, 1, want, file);
+        size_t i;
+        
+        if (n == 0) return 0;
+        for (i = 0; i < n; i++) {
+            hash = (hash ^ buffer[i]) * 16777619UL;
+        }
+        start += n;
+    }
+    return hash;
+}
+
+// Checksum of the first length bytes of a file, used to tell an append from
+// an in-place rewrite that happens to make the file longer. Prefixes up to
+// two STREAM_BLOCK_SIZE blocks are covered entirely, longer ones by their
+// first and last block
+static unsigned long prefixChecksum(FILE *file, long length) {
+    unsigned long hash = 2166136261UL;
+    
+    if (length <= 2L * STREAM_BLOCK_SIZE) {
+        return checksumRange(file, 0, length, hash);
+    }
+    hash = checksumRange(file, 0, STREAM_BLOCK_SIZE, hash);
+    return checksumRange(file, length - STREAM_BLOCK_SIZE, length, hash);
+}
+
+// Number of threads used to parse one large file
+static int parseWorkerCount() {
+    int workers = 4;
+    
+#ifdef _SC_NPROCESSORS_ONLN
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (workers < 1) workers = 1;
+    if (workers > MAX_PARSE_WORKERS) workers = MAX_PARSE_WORKERS;
+    return workers;
+}
+
+// One newline-aligned slice of a file, parsed by its own thread
+typedef struct {
+    FileCache *cache;
+    long start;
+    long end;
+    void *rows;
+    int capacity;           // rows allocated; grows like a cache
+    int count;
+    StringPool strings;     // appended to the cache's pool when joining
+    int failed;             // out of memory or could not open the file
+} ParseChunk;
+
+// Parse the lines that start inside a chunk
+static void *parseChunk(void *arg) {
+    ParseChunk *chunk = (ParseChunk *)arg;
+    FileCache *cache = chunk->cache;
+    FILE *file = fopen(cache->path, "r");
+    LineReader reader;
+    char *line;
+    long offset = chunk->start;
+    
+    chunk->count = 0;
+    if (file == NULL) {
+        chunk->failed = 1;
+        return NULL;
+    }
+    
+    // The line running into the chunk belongs to the previous one
+    if (chunk->start > 0 && fseek(file, chunk->start - 1, SEEK_SET) == 0 && fgetc(file) != '\n') {
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '\n') offset++;
+        offset++;
+    }
+    if (!openLineReader(&reader, file, offset)) {
+        chunk->failed = 1;
+        fclose(file);
+        return NULL;
+    }
+    
+    poolStartIndex(&chunk->strings);
+    while (reader.offset < chunk->end && (line = readLine(&reader)) != NULL) {
+        void *row;
+        int parsed;
+        
+        if (chunk->count == chunk->capacity) {
+            int capacity = chunk->capacity > 0 ? chunk->capacity * 2 : 256;
+            void *rows = chunk->capacity <= INT_MAX / 2 ?
+                         realloc(chunk->rows, cache->row_size * capacity) : NULL;
+            
+            if (rows == NULL) {
+                chunk->failed = 1;
+                break;
+            }
+            chunk->rows = rows;
+            chunk->capacity = capacity;
+        }
+        row = (char *)chunk->rows + cache->row_size * chunk->count;
+        parsed = cache->parse_line(line, row, &chunk->strings);
+        if (parsed < 0) {
+            chunk->failed = 1;
+            break;
+        }
+        if (parsed > 0) {
+            chunk->count++;
+        }
+    }
+    poolDropIndex(&chunk->strings);
+    
+    closeLineReader(&reader);
+    fclose(file);
+    return NULL;
+}
+
+// Parse a whole file with one thread per chunk and join the rows in file
+// order. Returns 0 if the file should be parsed serially instead, which is
+// also the fallback when a chunk or the cache cannot grow
+static int parseCacheParallel(FileCache *cache, FILE *file, long size) {
+    ParseChunk chunks[MAX_PARSE_WORKERS];
+    pthread_t threads[MAX_PARSE_WORKERS];
+    int started[MAX_PARSE_WORKERS];
+    int workers = parseWorkerCount();
+    int failed = 0;
+    int total = 0;
+    int i;
+    
+    if (size < PARALLEL_PARSE_MIN_BYTES || workers == 1) {
+        return 0;
+    }
+    
+    for (i = 0; i < workers; i++) {
+        chunks[i].cache = cache;
+        chunks[i].start = size / workers * i;
+        chunks[i].end = i == workers - 1 ? size : size / workers * (i + 1);
+        chunks[i].rows = NULL;
+        chunks[i].capacity = 0;
+        chunks[i].count = 0;
+        memset(&chunks[i].strings, 0, sizeof(StringPool));
+        chunks[i].failed = 0;
+    }
+    
+    for (i = 0; i < workers; i++) {
+        started[i] = pthread_create(&threads[i], NULL, parseChunk, &chunks[i]) == 0;
+        if (!started[i]) {
+            parseChunk(&chunks[i]);
+        }
+    }
+    
+    for (i = 0; i < workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (chunks[i].failed || chunks[i].count > INT_MAX - total) {
+            failed = 1;
+        } else {
+            total += chunks[i].count;
+        }
+    }
+    
+    // Each chunk's strings go after the previous chunks', so the offsets in
+    // its rows move by where they start
+    if (!failed && growCache(cache, total)) {
+        for (i = 0; i < workers && !failed; i++) {
+            char *rows = (char *)cache->rows + cache->row_size * cache->count;
+            uint32_t base;
+            int j;
+            
+            if (!poolAppend(&cache->strings, &chunks[i].strings, &base)) {
+                failed = 1;
+                break;
+            }
+            memcpy(rows, chunks[i].rows, cache->row_size * chunks[i].count);
+            if (cache->rebase_row != NULL && base > 0) {
+                for (j = 0; j < chunks[i].count; j++) {
+                    cache->rebase_row(rows + cache->row_size * j, base);
+                }
+            }
+            cache->count += chunks[i].count;
+        }
+    } else {
+        failed = 1;
+    }
+    for (i = 0; i < workers; i++) {
+        free(chunks[i].rows);
+        poolFree(&chunks[i].strings);
+    }
+    
+    if (failed) {
+        cache->count = 0;
+        poolClear(&cache->strings);
+        rewind(file);
+        return 0;
+    }
+    
+    // Same rule as parseIntoCache: appends can only be parsed on their own
+    // after a complete last line
+    cache->parsed_bytes = -1;
+    if (fseek(file, size - 1, SEEK_SET) == 0 && fgetc(file) == '\n') {
+        cache->parsed_bytes = size;
+    }
+    return 1;
+}
+
+// books.txt cache being filled from books.pack
+typedef struct {
+    FileCache *cache;
+    uint32_t *authors;      // author index -> offset in the string pool
+    unsigned long author_count;
+} PackedBooks;
+
+// Size the cache and the author table from the pack's counts
+static int startPackedBooks(unsigned long books, unsigned long authors, void *context) {
+    PackedBooks *packed = (PackedBooks *)context;
+    
+    if (books > INT_MAX || !growCache(packed->cache, (int)books)) {
+        return 0;
+    }
+    packed->authors = malloc(sizeof(uint32_t) * (authors + 1));
+    return packed->authors != NULL;
+}
+
+// Store each author once; books then refer to it by index
+static int addPackedAuthor(const char *name, void *context) {
+    PackedBooks *packed = (PackedBooks *)context;
+    return poolAdd(&packed->cache->strings, name, &packed->authors[packed->author_count++]);
+}
+
+static int addPackedBook(int id, const char *title, unsigned long author, void *context) {
+    PackedBooks *packed = (PackedBooks *)context;
+    FileCache *cache = packed->cache;
+    CatalogRow *row;
+    
+    if (!growCache(cache, cache->count + 1)) {
+        return 0;
+    }
+    row = (CatalogRow *)cache->rows + cache->count;
+    row->id = id;
+    row->author = packed->authors[author];
+    if (!poolAdd(&cache->strings, title, &row->title)) {
+        return 0;
+    }
+    cache->count++;
+    return 1;
+}
+
+// Fill the books.txt cache from books.pack if it was built from this exact
+// books.txt (see buildBookPack). Returns 0 to parse the text instead
+static int loadBookPack(FileCache *cache, FILE *file) {
+    PackedBooks packed;
+    PackSource source;
+    PackVisitor visitor;
+    int ok;
+    
+    packed.cache = cache;
+    packed.authors = NULL;
+    packed.author_count = 0;
+    source.size = (unsigned long long)cache->size;
+    source.mtime = (long long)cache->mtime;
+    source.mtime_nsec = cache->mtime_nsec;
+    source.inode = cache->inode;
+    visitor.start = startPackedBooks;
+    visitor.author = addPackedAuthor;
+    visitor.book = addPackedBook;
+    visitor.context = &packed;
+    
+    ok = packLoad(BOOK_PACK_FILE, &source, &visitor);
+    free(packed.authors);
+    if (!ok) {
+        cache->count = 0;
+        poolClear(&cache->strings);
+        return 0;
+    }
+    
+    // Same rule as parseIntoCache for parsing appends on their own
+    cache->parsed_bytes = -1;
+    if (cache->size == 0 || (fseek(file, cache->size - 1, SEEK_SET) == 0 && fgetc(file) == '\n')) {
+        cache->parsed_bytes = cache->size;
+    }
+    rewind(file);
+    return 1;
+}
+
+// Bring a cache up to date with its file. Costs nothing when inotify reports
+// no change, a stat when the file is unchanged, and parses only the new
+// lines when the file was appended to
+static void refreshCache(FileCache *cache) {
+#ifdef __linux__
+    pollFileEvents();
+    if (cache->loaded && !cache->dirty && inotify_fd >= 0) {
+        return;
+    }
+#endif
+    reloadCache(cache);
+}
+
+// Check a cache against its file and parse whatever changed. Only this
+// cache is touched, so different caches can be reloaded in parallel
+static void reloadCache(FileCache *cache) {
+    struct stat st;
+    FILE *file;
+    int append;
+    
+    cache->dirty = 0;
+    
+    if (stat(cache->path, &st) != 0) {
+        if (!cache->loaded || cache->exists) {
+            cache->version++;
+        }
+        cache->count = 0;
+        poolClear(&cache->strings);
+        cache->loaded = 1;
+        cache->exists = 0;
+        return;
+    }
+    
+    long mtime_nsec = 0;
+#ifdef __linux__
+    mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    
+    if (cache->loaded && cache->exists &&
+        cache->inode == (unsigned long)st.st_ino &&
+        cache->size == (long)st.st_size &&
+        cache->mtime == st.st_mtime &&
+        cache->mtime_nsec == mtime_nsec) {
+        return;
+    }
+    
+    file = fopen(cache->path, "r");
+    if (file == NULL) {
+        cache->count = 0;
+        poolClear(&cache->strings);
+        cache->loaded = 0;
+        cache->version++;
+        return;
+    }
+    
+    // Only append to what we have if the file grew in place and the old
+    // contents are unchanged. A rewrite (truncate, then write more than
+    // before) also grows the file, and on Linux looks like any other
+    // IN_MODIFY, so the checksum is what tells them apart
+    append = cache->loaded && cache->exists &&
+             cache->inode == (unsigned long)st.st_ino &&
+             cache->parsed_bytes >= 0 &&
+             (long)st.st_size > cache->size &&
+             cache->parsed_bytes == cache->size &&
+             prefixChecksum(file, cache->parsed_bytes) == cache->prefix_checksum;
+    
+    if (append) {
+        fseek(file, cache->parsed_bytes, SEEK_SET);
+    } else {
+        rewind(file);
+        cache->count = 0;
+        poolClear(&cache->strings);
+        cache->parsed_bytes = 0;
+    }
+    
+    cache->inode = (unsigned long)st.st_ino;
+    cache->size = (long)st.st_size;
+    cache->mtime = st.st_mtime;
+    cache->mtime_nsec = mtime_nsec;
+    cache->exists = 1;
+    cache->loaded = 1;
+    
+    // Appended lines are stored without looking for earlier copies
+    if (append) {
+        parseIntoCache(cache, file, cache->parsed_bytes);
+    } else if ((cache->load_packed == NULL || !cache->load_packed(cache, file)) &&
+               !parseCacheParallel(cache, file, (long)st.st_size)) {
+        poolStartIndex(&cache->strings);
+        parseIntoCache(cache, file, 0);
+        poolDropIndex(&cache->strings);
+    }
+    if (cache->parsed_bytes >= 0) {
+        cache->prefix_checksum = prefixChecksum(file, cache->parsed_bytes);
+    }
+    cache->version++;
+    fclose(file);
+}
+
+// Drop a cache after we rewrote its file ourselves
+static void invalidateCache(FileCache *cache) {
+    cache->loaded = 0;
+}
+
+// Load all books from books.txt
+int loadBooks(Book books[], int max_books) {
+    const CatalogRow *rows;
+    int count;
+    int i;
+    
+    refreshCache(&books_cache);
+    rows = (const CatalogRow *)books_cache.rows;
+    count = books_cache.count < max_books ? books_cache.count : max_books;
+    for (i = 0; i < count; i++) {
+        books[i].id = rows[i].id;
+        strcpy(books[i].title, poolString(&books_cache.strings, rows[i].title));
+        strcpy(books[i].author, poolString(&books_cache.strings, rows[i].author));
+    }
+    return count;
+}
+
+// Entry of the catalog index: a book ID and its row in the books.txt cache
+typedef struct {
+    int id;
+    int row;
+} CatalogKey;
+
+// Compare catalog index entries by ID, then file order (for qsort)
+static int compareCatalogKey(const void *a, const void *b) {
+    const CatalogKey *key_a = (const CatalogKey *)a;
+    const CatalogKey *key_b = (const CatalogKey *)b;
+    
+    if (key_a->id != key_b->id) {
+        return (key_a->id > key_b->id) - (key_a->id < key_b->id);
+    }
+    return (key_a->row > key_b->row) - (key_a->row < key_b->row);
+}
+
+// One run of the catalog index, sorted by its own thread
+typedef struct {
+    CatalogKey *keys;
+    int count;
+} SortRun;
+
+// Sort one run
+static void *sortRun(void *arg) {
+    SortRun *run = (SortRun *)arg;
+    qsort(run->keys, run->count, sizeof(CatalogKey), compareCatalogKey);
+    return NULL;
+}
+
+// Sort the catalog index. Nothing to do when books.txt is already in ID
+// order; large indexes are sorted as one run per parse worker in parallel,
+// then the runs are merged pairwise
+static void sortCatalogIndex(CatalogKey *keys, int count) {
+    SortRun runs[MAX_PARSE_WORKERS];
+    pthread_t threads[MAX_PARSE_WORKERS];
+    int started[MAX_PARSE_WORKERS];
+    int bounds[MAX_PARSE_WORKERS + 1];
+    int workers = parseWorkerCount();
+    CatalogKey *source = keys;
+    CatalogKey *target;
+    int i;
+    
+    for (i = 1; i < count && compareCatalogKey(&keys[i - 1], &keys[i]) <= 0; i++);
+    if (i >= count) {
+        return;
+    }
+    
+    target = count >= PARALLEL_SORT_MIN_KEYS && workers > 1 ? malloc(sizeof(CatalogKey) * count) : NULL;
+    if (target == NULL) {
+        qsort(keys, count, sizeof(CatalogKey), compareCatalogKey);
+        return;
+    }
+    
+    for (i = 0; i <= workers; i++) {
+        bounds[i] = (int)((long long)count * i / workers);
+    }
+    for (i = 0; i < workers; i++) {
+        runs[i].keys = keys + bounds[i];
+        runs[i].count = bounds[i + 1] - bounds[i];
+        started[i] = pthread_create(&threads[i], NULL, sortRun, &runs[i]) == 0;
+        if (!started[i]) {
+            sortRun(&runs[i]);
+        }
+    }
+    for (i = 0; i < workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    
+    // Each pass merges neighbouring runs, halving their number
+    while (workers > 1) {
+        int runs_left = 0;
+        CatalogKey *swap;
+        
+        for (i = 0; i < workers; i += 2) {
+            int a = bounds[i];
+            int a_end = bounds[i + 1];
+            int b = a_end;
+            int b_end = i + 1 < workers ? bounds[i + 2] : a_end;
+            int out = a;
+            
+            while (a < a_end && b < b_end) {
+                if (compareCatalogKey(&source[b], &source[a]) < 0) target[out++] = source[b++];
+                else target[out++] = source[a++];
+            }
+            while (a < a_end) target[out++] = source[a++];
+            while (b < b_end) target[out++] = source[b++];
+            bounds[runs_left++] = bounds[i];
+        }
+        bounds[runs_left] = count;
+        workers = runs_left;
+        swap = source;
+        source = target;
+        target = swap;
+    }
+    
+    if (source != keys) {
+        memcpy(keys, source, sizeof(CatalogKey) * count);
+        free(source);
+    } else {
+        free(target);
+    }
+}
+
+// books.txt rows sorted by ID - the catalog is the title/author dictionary
+// that available_books.txt and borrowed_books.txt refer to by book ID
+static CatalogKey *catalog_index = NULL;
+static int catalog_index_count = 0;
+static int catalog_index_capacity = 0;
+static unsigned long catalog_index_version = 0;
+
+// Rebuild the catalog index if books.txt changed since the last build
+static void buildCatalogIndex() {
+    const CatalogRow *rows = (const CatalogRow *)books_cache.rows;
+    int i;
+    
+    if (catalog_index != NULL && catalog_index_version == books_cache.version) {
+        return;
+    }
+    if (catalog_index == NULL || catalog_index_capacity < books_cache.count) {
+        CatalogKey *grown = realloc(catalog_index, sizeof(CatalogKey) * (books_cache.count + 1));
+        if (grown == NULL) {
+            catalog_index_count = 0;
+            catalog_index_version = 0;
+            return;
+        }
+        catalog_index = grown;
+        catalog_index_capacity = books_cache.count + 1;
+    }
+    catalog_index_count = books_cache.count;
+    for (i = 0; i < catalog_index_count; i++) {
+        catalog_index[i].id = rows[i].id;
+        catalog_index[i].row = i;
+    }
+    sortCatalogIndex(catalog_index, catalog_index_count);
+    catalog_index_version = books_cache.version;
+}
+
+// Reload books.txt if it changed and bring the catalog index up to date.
+// Called once per operation; describeBook then only searches the index
+static void loadCatalog() {
+    refreshCache(&books_cache);
+    buildCatalogIndex();
+}
+
+// Find a book in the catalog by ID
+static const CatalogRow *findCatalogBook(int id) {
+    int low = 0;
+    int high = catalog_index_count;
+    
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (catalog_index[mid].id < id) low = mid + 1;
+        else high = mid;
+    }
+    if (low < catalog_index_count && catalog_index[low].id == id) {
+        return (const CatalogRow *)books_cache.rows + catalog_index[low].row;
+    }
+    return NULL;
+}
+
+// Title and author of a book in available_books.txt or borrowed_books.txt,
+// looked up in the catalog (call loadCatalog first). Books missing from the
+// catalog are kept, so saving doesn't drop them and loans can be returned
+static void describeBook(int id, const char **title, const char **author) {
+    const CatalogRow *entry = findCatalogBook(id);
+    
+    if (entry != NULL) {
+        *title = poolString(&books_cache.strings, entry->title);
+        *author = poolString(&books_cache.strings, entry->author);
+    } else {
+        *title = "(not in catalog)";
+        *author = "";
+    }
+}
+
+// Entry of the user index: a username and its row in the users.txt cache
+typedef struct {
+    const char *username;
+    int row;
+} UserKey;
+
+// users.txt rows sorted by username, for logins and registration checks
+static UserKey *user_index = NULL;
+static int user_index_count = 0;
+static int user_index_capacity = 0;
+static unsigned long user_index_version = 0;
+
+// Compare user index entries by username (for qsort)
+static int compareUsername(const void *a, const void *b) {
+    return strcmp(((const UserKey *)a)->username, ((const UserKey *)b)->username);
+}
+
+// Rebuild the user index if users.txt changed since the last build
+static void buildUserIndex() {
+    const UserRow *rows = (const UserRow *)users_cache.rows;
+    int i;
+    
+    if (user_index != NULL && user_index_version == users_cache.version) {
+        return;
+    }
+    if (user_index == NULL || user_index_capacity < users_cache.count) {
+        UserKey *grown = realloc(user_index, sizeof(UserKey) * (users_cache.count + 1));
+        if (grown == NULL) {
+            free(user_index);
+            user_index = NULL;
+            user_index_capacity = 0;
+            user_index_count = 0;
+            return;
+        }
+        user_index = grown;
+        user_index_capacity = users_cache.count + 1;
+    }
+    user_index_count = users_cache.count;
+    for (i = 0; i < user_index_count; i++) {
+        user_index[i].username = poolString(&users_cache.strings, rows[i].username);
+        user_index[i].row = i;
+    }
+    qsort(user_index, user_index_count, sizeof(UserKey), compareUsername);
+    user_index_version = users_cache.version;
+}
+
+// Look up a user in users.txt. With password NULL only the username has to
+// match. Returns 1 if found, 0 if not, -1 if users.txt can't be read
+static int findUser(const char *username, const char *password) {
+    User user;
+    FILE *file;
+    
+    refreshCache(&users_cache);
+    if (!users_cache.exists) {
+        return -1;
+    }
+    
+    buildUserIndex();
+    if (user_index != NULL) {
+        const UserRow *rows = (const UserRow *)users_cache.rows;
+        int low = 0;
+        int high = user_index_count;
+        
+        // First entry with this username, then all its duplicates
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (strcmp(user_index[mid].username, username) < 0) low = mid + 1;
+            else high = mid;
+        }
+        for (; low < user_index_count && strcmp(user_index[low].username, username) == 0; low++) {
+            if (password == NULL ||
+                strcmp(poolString(&users_cache.strings, rows[user_index[low].row].password), password) == 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    
+    // No memory for the index: scan the whole file
+    file = fopen(USERS_FILE, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    while (fscanf(file, "%255s %255s", user.username, user.password) == 2) {
+        if (strcmp(user.username, username) == 0 &&
+            (password == NULL || strcmp(user.password, password) == 0)) {
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// Milliseconds from a monotonic clock
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// One file loaded by the startup pipeline
+typedef struct {
+    FileCache *cache;
+    void (*build_index)(void);  // run right after parsing, or NULL
+    double start_ms;
+    double parsed_ms;
+    double indexed_ms;
+} StartupTask;
+
+// Load one file and build its index
+static void *runStartupTask(void *arg) {
+    StartupTask *task = (StartupTask *)arg;
+    
+    task->start_ms = nowMs();
+    reloadCache(task->cache);
+    task->parsed_ms = nowMs();
+    if (task->build_index != NULL) {
+        task->build_index();
+    }
+    task->indexed_ms = nowMs();
+    return NULL;
+}
+
+// Load all data files at startup, one thread per file. Large files are
+// further split into chunks parsed in parallel, and each file's index is
+// built as soon as that file is parsed, while the others are still loading
+void loadStartupData(int show_timing) {
+    StartupTask tasks[4];
+    pthread_t threads[4];
+    int started[4];
+    int task_count = 0;
+    double start = nowMs();
+    double total;
+    int i;
+    
+#ifdef __linux__
+    // Start watching before loading so no change is missed
+    pollFileEvents();
+#endif
+    
+    tasks[task_count].cache = &users_cache;
+    tasks[task_count++].build_index = buildUserIndex;
+    // With a paged catalog the book files are not used
+    if (paged_catalog == NULL) {
+        tasks[task_count].cache = &books_cache;
+        tasks[task_count++].build_index = buildCatalogIndex;
+        tasks[task_count].cache = &available_cache;
+        tasks[task_count++].build_index = NULL;
+        tasks[task_count].cache = &borrowed_cache;
+        tasks[task_count++].build_index = NULL;
+    }
+    
+    for (i = 0; i < task_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, runStartupTask, &tasks[i]) == 0;
+        if (!started[i]) {
+            runStartupTask(&tasks[i]);
+        }
+    }
+    for (i = 0; i < task_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    total = nowMs() - start;
+    
+    if (!show_timing) {
+        return;
+    }
+    printf("\n=== Startup Timing (%d parse threads per large file) ===\n", parseWorkerCount());
+    printf("%-22s %8s %12s %10s %10s %10s\n", "File", "Rows", "Bytes", "Start ms", "Parse ms", "Index ms");
+    printf("----------------------------------------------------------------------------\n");
+    for (i = 0; i < task_count; i++) {
+        printf("%-22s %8d %12ld %10.3f %10.3f %10.3f\n", tasks[i].cache->path, tasks[i].cache->count,
+               tasks[i].cache->exists ? tasks[i].cache->size : 0L, tasks[i].start_ms - start,
+               tasks[i].parsed_ms - tasks[i].start_ms, tasks[i].indexed_ms - tasks[i].parsed_ms);
+    }
+    printf("%-22s %8s %12s %10s %10.3f\n", "Total (wall)", "", "", "", total);
+}
+
+// Load available books from available_books.txt
+int loadAvailableBooks(Book books[], int max_books) {
+    const int *rows;
+    int count = 0;
+    int i;
+    
+    refreshCache(&available_cache);
+    loadCatalog();
+    rows = (const int *)available_cache.rows;
+    
+    for (i = 0; i < available_cache.count && count < max_books; i++) {
+        const char *title, *author;
+        
+        describeBook(rows[i], &title, &author);
+        books[count].id = rows[i];
+        strcpy(books[count].title, title);
+        strcpy(books[count].author, author);
+        count++;
+    }
+    
+    return count;
+}
+
+// Save available books to file
+int saveAvailableBooks(Book books[], int count) {
+    FILE *file = fopen(AVAILABLE_BOOKS_FILE, "w");
+    int i;
+    
+    if (file == NULL) {
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        fprintf(file, "%d\n", books[i].id);
+    }
+    
+    fclose(file);
+    invalidateCache(&available_cache);
+    return 1;
+}
+
+// Load borrowed books from borrowed_books.txt
+int loadBorrowedBooks(BorrowedBook borrowed[], int max_borrowed) {
+    const LoanRow *rows;
+    int count = 0;
+    int i;
+    
+    refreshCache(&borrowed_cache);
+    loadCatalog();
+    rows = (const LoanRow *)borrowed_cache.rows;
+    
+    for (i = 0; i < borrowed_cache.count && count < max_borrowed; i++) {
+        const char *title, *author;
+        
+        describeBook(rows[i].book_id, &title, &author);
+        strcpy(borrowed[count].username, poolString(&borrowed_cache.strings, rows[i].username));
+        borrowed[count].book_id = rows[i].book_id;
+        strcpy(borrowed[count].title, title);
+        strcpy(borrowed[count].author, author);
+        count++;
+    }
+    
+    return count;
+}
+
+// Save borrowed books to file
+int saveBorrowedBooks(BorrowedBook borrowed[], int count) {
+    FILE *file = fopen(BORROWED_BOOKS_FILE, "w");
+    int i;
+    
+    if (file == NULL) {
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        fprintf(file, "%s;%d\n", borrowed[i].username, borrowed[i].book_id);
+    }
+    
+    fclose(file);
+    invalidateCache(&borrowed_cache);
+    return 1;
+}
+
+// Position of a book in the available_books.txt cache, or -1
+static int findAvailable(int book_id) {
+    const int *rows = (const int *)available_cache.rows;
+    int i;
+    
+    for (i = 0; i < available_cache.count; i++) {
+        if (rows[i] == book_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Position of a loan in the borrowed_books.txt cache, or -1
+static int findLoan(const char *username, int book_id) {
+    const LoanRow *rows = (const LoanRow *)borrowed_cache.rows;
+    int i;
+    
+    for (i = 0; i < borrowed_cache.count; i++) {
+        if (rows[i].book_id == book_id &&
+            strcmp(poolString(&borrowed_cache.strings, rows[i].username), username) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Rewrite available_books.txt from its cache, leaving out row skip
+static int saveAvailableCache(int skip) {
+    const int *rows = (const int *)available_cache.rows;
+    FILE *file = fopen(AVAILABLE_BOOKS_FILE, "w");
+    int ok;
+    int i;
+    
+    if (file == NULL) {
+        return 0;
+    }
+    for (i = 0; i < available_cache.count; i++) {
+        if (i != skip) {
+            fprintf(file, "%d\n", rows[i]);
+        }
+    }
+    ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    invalidateCache(&available_cache);
+    return ok;
+}
+
+// Rewrite borrowed_books.txt from its cache, leaving out row skip
+static int saveBorrowedCache(int skip) {
+    const LoanRow *rows = (const LoanRow *)borrowed_cache.rows;
+    FILE *file = fopen(BORROWED_BOOKS_FILE, "w");
+    int ok;
+    int i;
+    
+    if (file == NULL) {
+        return 0;
+    }
+    for (i = 0; i < borrowed_cache.count; i++) {
+        if (i != skip) {
+            fprintf(file, "%s;%d\n", poolString(&borrowed_cache.strings, rows[i].username), rows[i].book_id);
+        }
+    }
+    ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    invalidateCache(&borrowed_cache);
+    return ok;
+}
+
+// Append a line to a data file, ending its last line first if needed. The
+// cache then parses just the new line
+static int appendLine(const char *path, const char *text) {
+    FILE *file = fopen(path, "a+");
+    int ok;
+    
+    if (file == NULL) {
+        return 0;
+    }
+    if (fseek(file, -1, SEEK_END) == 0 && fgetc(file) != '\n') {
+        fseek(file, 0, SEEK_END);
+        fputc('\n', file);
+    }
+    fseek(file, 0, SEEK_END);
+    ok = fputs(text, file) >= 0;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// Initialize available_books.txt from books.txt if it doesn't exist
+void initializeAvailableBooks() {
+    FILE *available_file = fopen(AVAILABLE_BOOKS_FILE, "r");
+    if (available_file != NULL) {
+        fclose(available_file);
+        return; // File exists, no need to initialize
+    }
+    
+    // Copy the book IDs from books.txt to available_books.txt
+    FILE *books_file = fopen(BOOKS_FILE, "r");
+    if (books_file == NULL) {
+        return; // books.txt doesn't exist yet
+    }
+    
+    available_file = fopen(AVAILABLE_BOOKS_FILE, "w");
+    if (available_file == NULL) {
+        fclose(books_file);
+        return;
+    }
+    
+    char line[MAX_STRING * 3];
+    char field[MAX_STRING];
+    while (fgets(line, sizeof(line), books_file) != NULL) {
+        parseField(line, 0, field, sizeof(field));
+        trimString(field);
+        if (strlen(field) == 0) continue;
+        fprintf(available_file, "%d\n", atoi(field));
+    }
+    
+    fclose(books_file);
+    fclose(available_file);
+}
+
+// Buffer pool budget for the paged catalog, overridable with LIBRARY_POOL_PAGES
+static int pagedPoolPages() {
+    const char *value = getenv("LIBRARY_POOL_PAGES");
+    
+    if (value != NULL && atoi(value) > 0) {
+        return atoi(value);
+    }
+    return PAGED_POOL_PAGES;
+}
+
+// Open catalog.db if it exists - it then replaces the text files for
+// all book and loan operations
+static void openPagedCatalog() {
+    FILE *file = fopen(PAGED_CATALOG_FILE, "rb");
+    
+    if (file == NULL) {
+        return;
+    }
+    fclose(file);
+    
+    paged_catalog = pagedOpen(PAGED_CATALOG_FILE, pagedPoolPages(), 0);
+    if (paged_catalog == NULL) {
+        printf("Warning: %s is not a valid paged catalog, using text files.\n", PAGED_CATALOG_FILE);
+    }
+}
+
+// Find the loan line buildPagedCatalog keeps for each book: the last one, so a
+// book listed twice keeps its last borrower. Sets *lines to (book ID, line
+// number) pairs sorted for bsearch with compareCatalogKey and returns their
+// count, or -1 if out of memory
+static int lastLoanLines(CatalogKey **lines) {
+    FILE *file = fopen(BORROWED_BOOKS_FILE, "r");
+    CatalogKey *keys = NULL;
+    char line[MAX_STRING * 4];
+    int count = 0, capacity = 0, line_no = 0, kept = 0, i;
+    
+    *lines = NULL;
+    if (file == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *fields[2];
+        
+        line_no++;
+        if (!splitLoanLine(line, fields)) continue;
+        if (count == capacity) {
+            CatalogKey *grown;
+            
+            capacity = capacity > 0 ? capacity * 2 : 256;
+            grown = realloc(keys, sizeof(CatalogKey) * capacity);
+            if (grown == NULL) {
+                free(keys);
+                fclose(file);
+                return -1;
+            }
+            keys = grown;
+        }
+        keys[count].id = atoi(fields[1]);
+        keys[count].row = line_no;
+        count++;
+    }
+    fclose(file);
+    
+    if (count > 0) {
+        qsort(keys, count, sizeof(CatalogKey), compareCatalogKey);
+    }
+    for (i = 0; i < count; i++) {
+        if (i + 1 == count || keys[i + 1].id != keys[i].id) {
+            keys[kept++] = keys[i];
+        }
+    }
+    *lines = keys;
+    return kept;
+}
+
+// Build catalog.db from books.txt, available_books.txt and borrowed_books.txt.
+// Files are streamed line by line, so the catalog size is not limited by MAX_BOOKS.
+// Refused while catalog.db is in use: the text files stop being updated then,
+// so rebuilding from them would lose every loan made since
+int buildPagedCatalog() {
+    const char *temp_path = PAGED_CATALOG_FILE ".tmp";
+    PagedStore *store;
+    PagedBook record;
+    CatalogKey *loan_lines;
+    FILE *file;
+    char line[MAX_STRING * 4];
+    int books = 0, available = 0, borrowed = 0, loan_count;
+    
+    if (paged_catalog != NULL) {
+        printf("Error: %s is already in use and is newer than the text files!\n", PAGED_CATALOG_FILE);
+        printf("Delete it and restart to rebuild from the text files.\n");
+        return 0;
+    }
+    
+    loan_count = lastLoanLines(&loan_lines);
+    if (loan_count < 0) {
+        printf("Error: Out of memory!\n");
+        return 0;
+    }
+    store = pagedOpen(temp_path, pagedPoolPages(), 1);
+    if (store == NULL) {
+        free(loan_lines);
+        printf("Error: Cannot create %s!\n", temp_path);
+        return 0;
+    }
+    
+    file = fopen(BOOKS_FILE, "r");
+    if (file != NULL) {
+        char *fields[3];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (!splitBookLine(line, fields)) continue;
+            record.id = atoi(fields[0]);
+            record.available = 0;
+            strcpy(record.title, fields[1]);
+            strcpy(record.author, fields[2]);
+            if (pagedPut(store, &record)) books++;
+        }
+        fclose(file);
+    }
+    
+    // Availability and loans are in-place updates of the records above
+    file = fopen(AVAILABLE_BOOKS_FILE, "r");
+    if (file != NULL) {
+        int id;
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (parseAvailableLine(line, &id, NULL) <= 0) continue;
+            if (pagedSetAvailable(store, id, 1)) available++;
+        }
+        fclose(file);
+    }
+    
+    file = fopen(BORROWED_BOOKS_FILE, "r");
+    if (file != NULL) {
+        char *fields[2];
+        CatalogKey key;
+        
+        key.row = 0;
+        while (fgets(line, sizeof(line), file) != NULL) {
+            key.row++;
+            if (!splitLoanLine(line, fields)) continue;
+            key.id = atoi(fields[1]);
+            if (bsearch(&key, loan_lines, loan_count, sizeof(CatalogKey), compareCatalogKey) == NULL) continue;
+            if (pagedSetAvailable(store, key.id, 0) && pagedPutLoan(store, fields[0], key.id)) borrowed++;
+        }
+        fclose(file);
+    }
+    free(loan_lines);
     
-    if (book_id <= 0) {
-        printf("Error: Invalid book ID!\n");
-        return;
+    if (!pagedFlush(store)) {
+        pagedClose(store);
+        remove(temp_path);
+        printf("Error: Failed to write %s!\n", temp_path);
+        return 0;
+    }
+    pagedClose(store);
+    
+    // Swap the new catalog in
+    remove(PAGED_CATALOG_FILE);
+    if (rename(temp_path, PAGED_CATALOG_FILE) != 0) {
+        printf("Error: Cannot replace %s!\n", PAGED_CATALOG_FILE);
+        return 0;
+    }
+    openPagedCatalog();
+    
+    printf("Paged catalog built: %d books, %d available, %d borrowed.\n", books, available, borrowed);
+    return paged_catalog != NULL;
+}
+
+// Identify a books.txt for books.pack: the same fields the file caches
+// compare. Returns 0 if it can't be read
+static int bookPackSource(PackSource *source) {
+    struct stat st;
+    
+    if (stat(BOOKS_FILE, &st) != 0) {
+        return 0;
+    }
+    source->size = (unsigned long long)st.st_size;
+    source->mtime = (long long)st.st_mtime;
+    source->mtime_nsec = 0;
+#ifdef __linux__
+    source->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    source->inode = (unsigned long long)st.st_ino;
+    return 1;
+}
+
+// Build books.pack from books.txt: a dictionary of authors and compact
+// compressed book records, loaded instead of parsing books.txt as long as
+// books.txt is not changed. Run again after editing books.txt
+int buildBookPack() {
+    const char *temp_path = BOOK_PACK_FILE ".tmp";
+    BookPackWriter *writer;
+    PackSource before, after;
+    LineReader reader;
+    FILE *file;
+    char *line;
+    int books = 0;
+    int ok = 1;
+    
+    file = fopen(BOOKS_FILE, "r");
+    if (file == NULL || !bookPackSource(&before)) {
+        printf("Error: Cannot read %s!\n", BOOKS_FILE);
+        if (file != NULL) fclose(file);
+        return 0;
+    }
+    writer = packCreate(temp_path);
+    if (writer == NULL || !openLineReader(&reader, file, 0)) {
+        printf("Error: Cannot create %s!\n", temp_path);
+        if (writer != NULL) packFinish(writer, &before);
+        remove(temp_path);
+        fclose(file);
+        return 0;
+    }
+    
+    while (ok && (line = readLine(&reader)) != NULL) {
+        char *fields[3];
+        
+        if (!splitBookLine(line, fields)) continue;
+        ok = packAddBook(writer, atoi(fields[0]), fields[1], fields[2]);
+        books++;
+    }
+    closeLineReader(&reader);
+    fclose(file);
+    
+    // An edit while packing would leave the pack describing neither version
+    if (ok && (!bookPackSource(&after) || memcmp(&before, &after, sizeof(PackSource)) != 0)) {
+        printf("Error: %s changed while packing it, please try again!\n", BOOKS_FILE);
+        packFinish(writer, &before);
+        remove(temp_path);
+        return 0;
+    }
+    if (!packFinish(writer, &before) || !ok) {
+        remove(temp_path);
+        printf("Error: Failed to write %s!\n", temp_path);
+        return 0;
+    }
+    
+    remove(BOOK_PACK_FILE);
+    if (rename(temp_path, BOOK_PACK_FILE) != 0) {
+        printf("Error: Cannot replace %s!\n", BOOK_PACK_FILE);
+        return 0;
+    }
+    invalidateCache(&books_cache);
+    printf("Packed catalog built: %d books in %s.\n", books, BOOK_PACK_FILE);
+    return 1;
+}
+
+// Print one row of a paged catalog listing, with the table header first
+static void printPagedRow(const PagedBook *record, int *shown) {
+    if (*shown == 0) {
+        printf("%-5s %-40s %-30s\n", "ID", "Title", "Author");
+        printf("----------------------------------------------------------------------------\n");
+    }
+    printf("%-5d %-40s %-30s\n", record->id, record->title, record->author);
+    (*shown)++;
+}
+
+// Paged catalog scan callback listing available books
+static int printAvailablePagedBook(const PagedBook *record, void *context) {
+    if (record->available) {
+        printPagedRow(record, (int *)context);
+    }
+    return 1;
+}
+
+// Loan scan callback listing a member's books
+static int printLoanedPagedBook(int book_id, void *context) {
+    PagedBook record;
+    
+    if (pagedLookup(paged_catalog, book_id, &record)) {
+        printPagedRow(&record, (int *)context);
     }
+    return 1;
+}
+
+// List available books in the paged catalog. Returns the number shown
+static int listPagedAvailable() {
+    int shown = 0;
+    
+    if (!pagedBegin(paged_catalog, 0)) {
+        printf("Error: Cannot lock %s!\n", PAGED_CATALOG_FILE);
+        return -1;
+    }
+    pagedScan(paged_catalog, INT_MIN, INT_MAX, printAvailablePagedBook, &shown);
+    pagedEnd(paged_catalog);
+    return shown;
+}
+
+// List the books borrowed by username from the loan tree, without scanning
+// the catalog. Returns the number shown
+static int listPagedLoans(const char *username) {
+    int shown = 0;
     
-    // Load available books
-    available_count = loadAvailableBooks(available_books, MAX_BOOKS);
+    if (!pagedBegin(paged_catalog, 0)) {
+        printf("Error: Cannot lock %s!\n", PAGED_CATALOG_FILE);
+        return -1;
+    }
+    pagedScanLoans(paged_catalog, username, printLoanedPagedBook, &shown);
+    pagedEnd(paged_catalog);
+    return shown;
+}
+
+// Output buffer written to a stream in bulk
+typedef struct {
+    FILE *out;
+    size_t length;
+    char data[STREAM_BLOCK_SIZE];
+} OutputBuffer;
+
+// Write out everything buffered so far
+static void flushOutput(OutputBuffer *output) {
+    if (output->length > 0) {
+        fwrite(output->data, 1, output->length, output->out);
+        output->length = 0;
+    }
+    fflush(output->out);
+}
+
+// Append bytes to the output buffer
+static void writeOutput(OutputBuffer *output, const char *text, size_t length) {
+    while (length > 0) {
+        size_t space = STREAM_BLOCK_SIZE - output->length;
+        size_t chunk = length < space ? length : space;
+        
+        memcpy(output->data + output->length, text, chunk);
+        output->length += chunk;
+        text += chunk;
+        length -= chunk;
+        if (output->length == STREAM_BLOCK_SIZE) {
+            flushOutput(output);
+        }
+    }
+}
+
+// Append a CSV field, quoted if it contains a separator, quote or newline
+static void writeCsvField(OutputBuffer *output, const char *field) {
+    const char *p;
     
-    // Find the book in available books
-    for (i = 0; i < available_count; i++) {
-        if (available_books[i].id == book_id) {
-            found = 1;
+    if (strpbrk(field, ",\"\r\n") == NULL) {
+        writeOutput(output, field, strlen(field));
+        return;
+    }
+    writeOutput(output, "\"", 1);
+    for (p = field; *p != '\0'; p++) {
+        if (*p == '"') writeOutput(output, "\"", 1);
+        writeOutput(output, p, 1);
+    }
+    writeOutput(output, "\"", 1);
+}
+
+// Append a JSON string literal
+static void writeJsonString(OutputBuffer *output, const char *text) {
+    const char *p;
+    char escape[8];
+    
+    writeOutput(output, "\"", 1);
+    for (p = text; *p != '\0'; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            escape[0] = '\\';
+            escape[1] = (char)c;
+            writeOutput(output, escape, 2);
+        } else if (c < 0x20) {
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            writeOutput(output, escape, 6);
+        } else {
+            writeOutput(output, p, 1);
+        }
+    }
+    writeOutput(output, "\"", 1);
+}
+
+// Streamed listing or export in progress
+typedef struct {
+    OutputBuffer *output;
+    int format;             // LIST_TABLE, EXPORT_CSV or EXPORT_JSONL
+    int count;
+} BookStream;
+
+// Format one book into the output buffer
+static void streamBookRow(BookStream *stream, int id, const char *title, const char *author) {
+    char text[MAX_STRING * 3];
+    int length;
+    
+    switch (stream->format) {
+        case EXPORT_CSV:
+            length = snprintf(text, sizeof(text), "%d,", id);
+            writeOutput(stream->output, text, length);
+            writeCsvField(stream->output, title);
+            writeOutput(stream->output, ",", 1);
+            writeCsvField(stream->output, author);
+            writeOutput(stream->output, "\n", 1);
+            break;
+        case EXPORT_JSONL:
+            length = snprintf(text, sizeof(text), "{\"id\":%d,\"title\":", id);
+            writeOutput(stream->output, text, length);
+            writeJsonString(stream->output, title);
+            writeOutput(stream->output, ",\"author\":", 10);
+            writeJsonString(stream->output, author);
+            writeOutput(stream->output, "}\n", 2);
             break;
+        default:
+            if (stream->count == 0) {
+                length = snprintf(text, sizeof(text), "%-5s %-40s %-30s\n%s\n", "ID", "Title", "Author",
+                                  "----------------------------------------------------------------------------");
+                writeOutput(stream->output, text, length);
+            }
+            length = snprintf(text, sizeof(text), "%-5d %-40s %-30s\n", id, title, author);
+            writeOutput(stream->output, text, length);
+            break;
+    }
+    
+    // Show the first row right away, the rest in blocks
+    stream->count++;
+    if (stream->count == 1) {
+        flushOutput(stream->output);
+    }
+}
+
+// Visit every line of books.txt, reading it in STREAM_BLOCK_SIZE blocks so
+// memory use does not depend on the catalog size. Lines are read like the
+// file cache reads them, so an overlong line is the same truncated row here.
+// Returns the number of books
+static int streamBooks(BookStream *stream) {
+    FILE *file = fopen(BOOKS_FILE, "r");
+    LineReader reader;
+    char *line;
+    char *fields[3];
+    
+    if (file == NULL) {
+        return 0;
+    }
+    if (!openLineReader(&reader, file, 0)) {
+        fclose(file);
+        return 0;
+    }
+    
+    while ((line = readLine(&reader)) != NULL) {
+        if (splitBookLine(line, fields)) {
+            streamBookRow(stream, atoi(fields[0]), fields[1], fields[2]);
         }
     }
     
-    if (!found) {
-        printf("Error: Book ID %d is not available for borrowing!\n", book_id);
+    closeLineReader(&reader);
+    fclose(file);
+    return stream->count;
+}
+
+// Paged catalog scan callback for streamed listings and exports
+static int streamPagedBook(const PagedBook *record, void *context) {
+    streamBookRow((BookStream *)context, record->id, record->title, record->author);
+    return 1;
+}
+
+// Export the whole catalog to a file as CSV or JSON Lines
+int exportBooks(const char *path, int format) {
+    OutputBuffer *output = malloc(sizeof(OutputBuffer));
+    BookStream stream;
+    
+    if (output == NULL) {
+        return -1;
+    }
+    output->out = fopen(path, "w");
+    output->length = 0;
+    if (output->out == NULL) {
+        free(output);
+        return -1;
+    }
+    
+    stream.output = output;
+    stream.format = format;
+    stream.count = 0;
+    // The header is written even for an empty catalog
+    if (format == EXPORT_CSV) {
+        writeOutput(output, "id,title,author\n", 16);
+    }
+    if (paged_catalog != NULL) {
+        if (pagedBegin(paged_catalog, 0)) {
+            pagedScan(paged_catalog, INT_MIN, INT_MAX, streamPagedBook, &stream);
+            pagedEnd(paged_catalog);
+        } else {
+            stream.count = -1;
+        }
+    } else {
+        streamBooks(&stream);
+    }
+    
+    flushOutput(output);
+    if (ferror(output->out)) {
+        stream.count = -1;
+    }
+    fclose(output->out);
+    free(output);
+    return stream.count;
+}
+
+// Ask for an export format and file, then export the catalog
+static void exportCatalogMenu() {
+    char path[MAX_STRING];
+    int format;
+    int count;
+    
+    printf("\n=== Export Catalog ===\n");
+    printf("Format (1 = CSV, 2 = JSON Lines): ");
+    fflush(stdout);
+    format = getIntInput();
+    if (format != EXPORT_CSV && format != EXPORT_JSONL) {
+        printf("Error: Invalid format!\n");
+        return;
+    }
+    
+    printf("Enter output file name [%s]: ", format == EXPORT_CSV ? "books.csv" : "books.jsonl");
+    fflush(stdout);
+    if (fgets(path, sizeof(path), stdin) == NULL) {
         return;
     }
+    trimString(path);
+    if (strlen(path) == 0) {
+        strcpy(path, format == EXPORT_CSV ? "books.csv" : "books.jsonl");
+    }
+    
+    count = exportBooks(path, format);
+    if (count < 0) {
+        printf("Error: Cannot write %s!\n", path);
+    } else {
+        printf("Exported %d books to %s\n", count, path);
+    }
+}
+
+// Display all books, streamed from books.txt (or the paged catalog)
+void displayAllBooks() {
+    OutputBuffer *output = malloc(sizeof(OutputBuffer));
+    BookStream stream;
     
-    // Get selected book details
-    Book selected_book = available_books[i];
+    printf("\n=== All Books ===\n");
+    fflush(stdout);
+    if (output == NULL) {
+        printf("Error: Out of memory!\n");
+        return;
+    }
+    output->out = stdout;
+    output->length = 0;
+    stream.output = output;
+    stream.format = LIST_TABLE;
+    stream.count = 0;
+    
+    if (paged_catalog != NULL) {
+        if (pagedBegin(paged_catalog, 0)) {
+            pagedScan(paged_catalog, INT_MIN, INT_MAX, streamPagedBook, &stream);
+            pagedEnd(paged_catalog);
+        } else {
+            printf("Error: Cannot lock %s!\n", PAGED_CATALOG_FILE);
+            stream.count = -1;
+        }
+    } else {
+        streamBooks(&stream);
+    }
+    flushOutput(output);
+    free(output);
     
-    // Load borrowed books
-    borrowed_count = loadBorrowedBooks(borrowed, MAX_BORROWED);
+    if (stream.count == 0) {
+        printf("No books found in the system.\n");
+    }
+    printf("\n");
+}
+
+// Display available books
+void displayAvailableBooks() {
+    const int *rows;
+    int i;
     
-    // Add to borrowed books
-    strcpy(borrowed[borrowed_count].username, username);
-    borrowed[borrowed_count].book_id = selected_book.id;
-    strcpy(borrowed[borrowed_count].title, selected_book.title);
-    strcpy(borrowed[borrowed_count].author, selected_book.author);
-    borrowed_count++;
+    printf("\n=== Available Books ===\n");
+    if (paged_catalog != NULL) {
+        if (listPagedAvailable() == 0) {
+            printf("No books available at the moment.\n");
+        }
+        printf("\n");
+        return;
+    }
     
-    // Remove from available books
-    for (j = i; j < available_count - 1; j++) {
-        available_books[j] = available_books[j + 1];
+    refreshCache(&available_cache);
+    if (available_cache.count == 0) {
+        printf("No books available at the moment.\n");
+        return;
     }
-    available_count--;
     
-    // Save changes
-    if (saveAvailableBooks(available_books, available_count) && 
-        saveBorrowedBooks(borrowed, borrowed_count)) {
-        printf("Successfully borrowed: %s by %s\n", selected_book.title, selected_book.author);
+    printf("%-5s %-40s %-30s\n", "ID", "Title", "Author");
+    printf("----------------------------------------------------------------------------\n");
+    loadCatalog();
+    rows = (const int *)available_cache.rows;
+    for (i = 0; i < available_cache.count; i++) {
+        const char *title, *author;
+        
+        describeBook(rows[i], &title, &author);
+        printf("%-5d %-40s %-30s\n", rows[i], title, author);
+    }
+    printf("\n");
+}
+
+// Borrow from the paged catalog: clear the book's flag in place and add
+// the loan, all under the catalog's write lock
+static void borrowPaged(const char *username, int book_id) {
+    PagedBook record;
+    int ok;
+    
+    if (!pagedBegin(paged_catalog, 1)) {
+        printf("Error: Cannot lock %s!\n", PAGED_CATALOG_FILE);
+        return;
+    }
+    if (!pagedLookup(paged_catalog, book_id, &record) || !record.available) {
+        pagedEnd(paged_catalog);
+        printf("Error: Book ID %d is not available for borrowing!\n", book_id);
+        return;
+    }
+    ok = pagedSetAvailable(paged_catalog, book_id, 0) && pagedPutLoan(paged_catalog, username, book_id);
+    ok = pagedEnd(paged_catalog) && ok;
+    if (ok) {
+        printf("Successfully borrowed: %s by %s\n", record.title, record.author);
     } else {
         printf("Error: Failed to save changes!\n");
     }
 }
 
-// Return a book
-void returnBook(const char *username) {
-    BorrowedBook borrowed[MAX_BORROWED];
-    Book available_books[MAX_BOOKS];
-    int borrowed_count, available_count;
-    int i, j;
+// Borrow from the text files: find the book in the whole available list,
+// remove it and append the loan, all under the data file lock
+static void borrowFromFiles(const char *username, int book_id) {
+    const char *title, *author;
+    char line[MAX_STRING + 16];
+    int i, ok;
+    
+    if (!lockDataFiles()) {
+        printf("Error: Cannot lock %s!\n", LOCK_FILE);
+        return;
+    }
+    refreshCache(&available_cache);
+    i = findAvailable(book_id);
+    if (i < 0) {
+        unlockDataFiles();
+        printf("Error: Book ID %d is not available for borrowing!\n", book_id);
+        return;
+    }
+    loadCatalog();
+    describeBook(book_id, &title, &author);
+    
+    snprintf(line, sizeof(line), "%s;%d\n", username, book_id);
+    ok = saveAvailableCache(i) && appendLine(BORROWED_BOOKS_FILE, line);
+    unlockDataFiles();
+    if (ok) {
+        printf("Successfully borrowed: %s by %s\n", title, author);
+    } else {
+        printf("Error: Failed to save changes!\n");
+    }
+}
+
+// Borrow a book
+void borrowBook(const char *username) {
     int book_id;
-    int found = 0;
     
-    printf("\n=== Return a Book ===\n");
-    displayMyBorrowedBooks(username);
+    printf("\n=== Borrow a Book ===\n");
+    // Listing a paged catalog reads every leaf; leave that to option 2
+    if (paged_catalog != NULL) {
+        printf("Use \"Display available books\" to see which books can be borrowed.\n");
+    } else {
+        displayAvailableBooks();
+    }
     
-    printf("Enter book ID to return: ");
+    printf("Enter book ID to borrow: ");
     fflush(stdout);
     book_id = getIntInput();
     
@@ -550,70 +2437,123 @@ void returnBook(const char *username) {
         return;
     }
     
-    // Load borrowed books
-    borrowed_count = loadBorrowedBooks(borrowed, MAX_BORROWED);
-    
-    // Find the book borrowed by this user
-    for (i = 0; i < borrowed_count; i++) {
-        if (strcmp(borrowed[i].username, username) == 0 && borrowed[i].book_id == book_id) {
-            found = 1;
-            break;
-        }
+    if (paged_catalog != NULL) {
+        borrowPaged(username, book_id);
+    } else {
+        borrowFromFiles(username, book_id);
     }
-    
-    if (!found) {
+}
+
+// Return to the paged catalog: drop the loan, which the loan tree alone
+// records, and set the book's flag in place, all under the catalog's write
+// lock
+static void returnPaged(const char *username, int book_id) {
+    PagedBook record;
+    int ok;
+    
+    if (!pagedBegin(paged_catalog, 1)) {
+        printf("Error: Cannot lock %s!\n", PAGED_CATALOG_FILE);
+        return;
+    }
+    if (!pagedDeleteLoan(paged_catalog, username, book_id)) {
+        pagedEnd(paged_catalog);
         printf("Error: You haven't borrowed book ID %d!\n", book_id);
         return;
     }
+    ok = pagedLookup(paged_catalog, book_id, &record) && pagedSetAvailable(paged_catalog, book_id, 1);
+    ok = pagedEnd(paged_catalog) && ok;
+    if (ok) {
+        printf("Successfully returned: %s by %s\n", record.title, record.author);
+    } else {
+        printf("Error: Failed to save changes!\n");
+    }
+}
+
+// Return to the text files: find the loan in the whole borrowed list,
+// remove it and append the book to available books, all under the data
+// file lock
+static void returnToFiles(const char *username, int book_id) {
+    const char *title, *author;
+    char line[32];
+    int i, ok;
+    
+    if (!lockDataFiles()) {
+        printf("Error: Cannot lock %s!\n", LOCK_FILE);
+        return;
+    }
+    refreshCache(&borrowed_cache);
+    i = findLoan(username, book_id);
+    if (i < 0) {
+        unlockDataFiles();
+        printf("Error: You haven't borrowed book ID %d!\n", book_id);
+        return;
+    }
+    loadCatalog();
+    describeBook(book_id, &title, &author);
+    
+    snprintf(line, sizeof(line), "%d\n", book_id);
+    ok = saveBorrowedCache(i) && appendLine(AVAILABLE_BOOKS_FILE, line);
+    unlockDataFiles();
+    if (ok) {
+        printf("Successfully returned: %s by %s\n", title, author);
+    } else {
+        printf("Error: Failed to save changes!\n");
+    }
+}
+
+// Return a book
+void returnBook(const char *username) {
+    int book_id;
     
-    // Save book details before removing
-    int return_book_id = borrowed[i].book_id;
-    char return_title[MAX_STRING];
-    char return_author[MAX_STRING];
-    strcpy(return_title, borrowed[i].title);
-    strcpy(return_author, borrowed[i].author);
-    
-    // Load available books
-    available_count = loadAvailableBooks(available_books, MAX_BOOKS);
+    printf("\n=== Return a Book ===\n");
+    displayMyBorrowedBooks(username);
     
-    // Add back to available books
-    available_books[available_count].id = return_book_id;
-    strcpy(available_books[available_count].title, return_title);
-    strcpy(available_books[available_count].author, return_author);
-    available_count++;
+    printf("Enter book ID to return: ");
+    fflush(stdout);
+    book_id = getIntInput();
     
-    // Remove from borrowed books
-    for (j = i; j < borrowed_count - 1; j++) {
-        borrowed[j] = borrowed[j + 1];
+    if (book_id <= 0) {
+        printf("Error: Invalid book ID!\n");
+        return;
     }
-    borrowed_count--;
     
-    // Save changes
-    if (saveAvailableBooks(available_books, available_count) && 
-        saveBorrowedBooks(borrowed, borrowed_count)) {
-        printf("Successfully returned: %s by %s\n", return_title, return_author);
+    if (paged_catalog != NULL) {
+        returnPaged(username, book_id);
     } else {
-        printf("Error: Failed to save changes!\n");
+        returnToFiles(username, book_id);
     }
 }
 
 // Display user's borrowed books
 void displayMyBorrowedBooks(const char *username) {
-    BorrowedBook borrowed[MAX_BORROWED];
-    int count = loadBorrowedBooks(borrowed, MAX_BORROWED);
+    const LoanRow *rows;
     int i;
     int found = 0;
     
     printf("\n=== My Borrowed Books ===\n");
+    if (paged_catalog != NULL) {
+        if (listPagedLoans(username) == 0) {
+            printf("You haven't borrowed any books yet.\n");
+        }
+        printf("\n");
+        return;
+    }
     
-    for (i = 0; i < count; i++) {
-        if (strcmp(borrowed[i].username, username) == 0) {
+    refreshCache(&borrowed_cache);
+    loadCatalog();
+    rows = (const LoanRow *)borrowed_cache.rows;
+    
+    for (i = 0; i < borrowed_cache.count; i++) {
+        if (strcmp(poolString(&borrowed_cache.strings, rows[i].username), username) == 0) {
+            const char *title, *author;
+            
             if (!found) {
                 printf("%-5s %-40s %-30s\n", "ID", "Title", "Author");
                 printf("----------------------------------------------------------------------------\n");
                 found = 1;
             }
-            printf("%-5d %-40s %-30s\n", borrowed[i].book_id, borrowed[i].title, borrowed[i].author);
+            describeBook(rows[i].book_id, &title, &author);
+            printf("%-5d %-40s %-30s\n", rows[i].book_id, title, author);
         }
     }
     
@@ -668,13 +2608,52 @@ void displayUserMenu(const char *username) {
     }
 }
 
+// Display admin menu
+void displayAdminMenu() {
+    int choice;
+    
+    while (1) {
+        printf("\n");
+        printf("========================================\n");
+        printf("    Admin Panel\n");
+        printf("========================================\n");
+        printf("1. Build paged catalog (%s)\n", PAGED_CATALOG_FILE);
+        printf("2. Export catalog (CSV / JSON Lines)\n");
+        printf("3. Build packed catalog (%s)\n", BOOK_PACK_FILE);
+        printf("4. Exit\n");
+        printf("========================================\n");
+        printf("Enter your choice: ");
+        fflush(stdout);
+        choice = getIntInput();
+        
+        switch (choice) {
+            case 1:
+                buildPagedCatalog();
+                break;
+            case 2:
+                exportCatalogMenu();
+                break;
+            case 3:
+                buildBookPack();
+                break;
+            case 4:
+                return;
+            default:
+                printf("Error: Invalid choice! Please try again.\n");
+        }
+    }
+}
+
 // Main function
-int main() {
+int main(int argc, char *argv[]) {
     int choice;
     char username[MAX_STRING];
+    int show_timing = argc > 1 && strcmp(argv[1], "--timing") == 0;
     
     // Initialize available_books.txt if needed
     initializeAvailableBooks();
+    openPagedCatalog();
+    loadStartupData(show_timing);
     
     while (1) {
         displayAuthMenu();
@@ -691,11 +2670,12 @@ int main() {
                 break;
             case 3:
                 if (loginAdmin()) {
-                    printf("Admin panel features coming soon!\n");
+                    displayAdminMenu();
                 }
                 break;
             case 4:
                 printf("Thank you for using the Library Management System!\n");
+                pagedClose(paged_catalog);
                 exit(0);
             default:
                 printf("Error: Invalid choice! Please try again.\n");
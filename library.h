@@ -9,10 +9,27 @@
 #define MAX_STRING 256
 #define MAX_BOOKS 1000
 #define MAX_BORROWED 100
+#define STREAM_BLOCK_SIZE 65536     // read/write block for streamed listings and exports
+#define PARALLEL_PARSE_MIN_BYTES (1024L * 1024)  // files at least this big are parsed in chunks
+#define MAX_PARSE_WORKERS 16
+#define PARALLEL_SORT_MIN_KEYS 65536  // catalog indexes at least this big are sorted in runs
 #define USERS_FILE "users.txt"
 #define BOOKS_FILE "books.txt"
 #define AVAILABLE_BOOKS_FILE "available_books.txt"
 #define BORROWED_BOOKS_FILE "borrowed_books.txt"
+#define PAGED_CATALOG_FILE "catalog.db"
+#define BOOK_PACK_FILE "books.pack"
+#define LOCK_FILE "library.lock"
+
+// Paged catalog settings
+#define PAGE_SIZE 8192
+#define PAGED_POOL_PAGES 64         // default buffer pool budget (512 KB)
+#define PAGED_MIN_POOL_PAGES 8
+
+// Listing and export formats
+#define LIST_TABLE 0
+#define EXPORT_CSV 1
+#define EXPORT_JSONL 2
 
 // Admin credentials (hardcoded)
 #define ADMIN_USERNAME "admin"
@@ -39,6 +56,37 @@ typedef struct {
     char author[MAX_STRING];
 } BorrowedBook;
 
+// Book record read from or written to the paged catalog. It is stored
+// compactly (see pagestore.c); who borrowed it is only in the loan tree
+typedef struct {
+    int id;
+    int available;
+    char title[MAX_STRING];
+    char author[MAX_STRING];
+} PagedBook;
+
+// Paged catalog handle (see pagestore.c)
+typedef struct PagedStore PagedStore;
+
+// The books.txt a packed catalog was built from (see bookpack.c)
+typedef struct {
+    unsigned long long size;
+    long long mtime;
+    long long mtime_nsec;
+    unsigned long long inode;
+} PackSource;
+
+// Receives a packed catalog as it is unpacked; callbacks return 0 to stop
+typedef struct {
+    int (*start)(unsigned long books, unsigned long authors, void *context);
+    int (*author)(const char *name, void *context);
+    int (*book)(int id, const char *title, unsigned long author, void *context);
+    void *context;
+} PackVisitor;
+
+// Packed catalog being written (see bookpack.c)
+typedef struct BookPackWriter BookPackWriter;
+
 // Authentication functions
 int registerUser();
 int loginUser(char *username);
@@ -52,6 +100,36 @@ int saveAvailableBooks(Book books[], int count);
 int loadBorrowedBooks(BorrowedBook borrowed[], int max_borrowed);
 int saveBorrowedBooks(BorrowedBook borrowed[], int count);
 void initializeAvailableBooks();
+void loadStartupData(int show_timing);
+
+// Paged catalog operations
+PagedStore *pagedOpen(const char *path, int pool_pages, int create);
+void pagedClose(PagedStore *store);
+int pagedBegin(PagedStore *store, int write);
+int pagedEnd(PagedStore *store);
+int pagedFlush(PagedStore *store);
+int pagedCount(PagedStore *store);
+int pagedLookup(PagedStore *store, int id, PagedBook *record);
+int pagedPut(PagedStore *store, const PagedBook *record);
+int pagedSetAvailable(PagedStore *store, int id, int available);
+int pagedScan(PagedStore *store, int from_id, int to_id,
+              int (*visit)(const PagedBook *record, void *context), void *context);
+int pagedPutLoan(PagedStore *store, const char *username, int book_id);
+int pagedDeleteLoan(PagedStore *store, const char *username, int book_id);
+int pagedScanLoans(PagedStore *store, const char *username,
+                   int (*visit)(int book_id, void *context), void *context);
+int buildPagedCatalog();
+
+// Packed catalog operations
+BookPackWriter *packCreate(const char *path);
+int packAddBook(BookPackWriter *writer, int id, const char *title, const char *author);
+int packFinish(BookPackWriter *writer, const PackSource *source);
+int packLoad(const char *path, const PackSource *source, const PackVisitor *visitor);
+int buildBookPack();
+int exportBooks(const char *path, int format);
+
+// Admin menu functions
+void displayAdminMenu();
 
 // User menu functions
 void displayAllBooks();
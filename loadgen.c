@@ -0,0 +1,980 @@
+#define _XOPEN_SOURCE 700
+
+#include "library.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Load generator: runs N simulated members, each driving its own ./library
+// process through the menus over pipes, and reports throughput, latency
+// percentiles and error/conflict rates per operation.
+//
+// Usage: ./loadgen [options]
+//   -n members     concurrent members (default 8)
+//   -o ops         operations per member (default 200)
+//   -m L:S:B:R     operation mix weights for login, list, borrow, return (default 1:4:3:2)
+//   -t ms          mean think time between operations, uniform jitter (default 0)
+//   -r trace       replay a JSON Lines trace instead of a random mix
+//   -p program     library executable (default ./library)
+//   -C dir         run in dir (use a copy of the data files - members are registered in users.txt)
+//   -s seed        random seed
+
+#define MENU_PROMPT "Enter your choice: "
+#define PASSWORD_PROMPT "Enter password: "
+#define READ_TIMEOUT_MS 30000
+#define STOP_TIMEOUT_MS 1000
+#define MAX_LISTED 4096
+#define MAX_LOANS 64
+#define MAX_TRACE_MEMBERS 1024
+
+// Operation types
+enum { OP_LOGIN, OP_LIST, OP_BORROW, OP_RETURN, OP_COUNT };
+static const char *op_names[OP_COUNT] = {"login", "list", "borrow", "return"};
+
+// Operation outcomes
+enum { OUTCOME_OK, OUTCOME_CONFLICT, OUTCOME_ERROR };
+
+// One measured operation, sent from a member process to the coordinator
+typedef struct {
+    int op;
+    int outcome;
+    double ms;
+} Sample;
+
+// One line of a replayed trace
+typedef struct {
+    int member;
+    int op;
+    int book_id;        // 0: pick one like the random mix does
+    int think_ms;       // -1: use the -t default
+} TraceEntry;
+
+// A running ./library session
+typedef struct {
+    pid_t pid;
+    int to_child;
+    int from_child;
+    char *output;
+    size_t length;
+    size_t capacity;
+    int broken;         // a command failed or timed out: do not talk to it again
+    int logged_in;
+    char username[MAX_STRING];
+    int listed[MAX_LISTED];
+    int listed_count;
+    int loans[MAX_LOANS];
+    int loan_count;
+} Session;
+
+// Load generator options
+typedef struct {
+    int members;
+    int ops;
+    int weights[OP_COUNT];
+    int think_ms;
+    const char *trace_path;
+    char program[PATH_MAX];
+    const char *directory;
+    unsigned int seed;
+} Options;
+
+// Milliseconds from a monotonic clock
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Sleep for a number of milliseconds
+static void sleepMs(double ms) {
+    struct timespec ts;
+
+    if (ms <= 0) {
+        return;
+    }
+    ts.tv_sec = (time_t)(ms / 1000);
+    ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000.0);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+// Think time drawn uniformly from [0, 2 * mean]
+static double thinkTime(int mean_ms) {
+    return mean_ms > 0 ? 2.0 * mean_ms * rand() / RAND_MAX : 0;
+}
+
+static void stopSession(Session *session);
+
+// Start ./library with its stdin and stdout connected to pipes
+static int startSession(Session *session, const char *program) {
+    int to_child[2], from_child[2];
+
+    memset(session, 0, sizeof(Session));
+    if (pipe(to_child) != 0) {
+        return 0;
+    }
+    if (pipe(from_child) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return 0;
+    }
+
+    session->pid = fork();
+    if (session->pid < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        return 0;
+    }
+    if (session->pid == 0) {
+        // The coordinator ignores SIGPIPE, and ignored signals survive exec
+        signal(SIGPIPE, SIG_DFL);
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        execl(program, program, (char *)NULL);
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    session->to_child = to_child[1];
+    session->from_child = from_child[0];
+    session->capacity = 65536;
+    session->output = malloc(session->capacity);
+    if (session->output == NULL) {
+        session->broken = 1;
+        stopSession(session);
+        return 0;
+    }
+    return 1;
+}
+
+// Send menu input to the session
+static int sendInput(Session *session, const char *input) {
+    size_t length = strlen(input);
+    size_t written = 0;
+
+    while (written < length) {
+        ssize_t n = write(session->to_child, input + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        written += n;
+    }
+    return 1;
+}
+
+// Check whether the output read so far ends with a prompt
+static int endsWith(const Session *session, const char *prompt) {
+    size_t prompt_length = strlen(prompt);
+
+    return session->length >= prompt_length &&
+           memcmp(session->output + session->length - prompt_length, prompt, prompt_length) == 0;
+}
+
+// Read output until the session waits at a menu again, or at prompt if it
+// is not NULL. Every menu ends with the same prompt, and every prompt
+// flushes stdout before reading. Returns 1 at the menu, 2 at prompt and 0
+// on failure
+static int readUntilPrompt(Session *session, const char *prompt) {
+    session->length = 0;
+    while (1) {
+        struct pollfd pfd;
+        ssize_t n;
+
+        if (endsWith(session, MENU_PROMPT) || (prompt != NULL && endsWith(session, prompt))) {
+            session->output[session->length] = '\0';
+            return endsWith(session, MENU_PROMPT) ? 1 : 2;
+        }
+
+        if (session->capacity - session->length < 4096) {
+            char *grown = realloc(session->output, session->capacity * 2);
+            if (grown == NULL) return 0;
+            session->output = grown;
+            session->capacity *= 2;
+        }
+
+        pfd.fd = session->from_child;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, READ_TIMEOUT_MS) <= 0) {
+            return 0;
+        }
+        n = read(session->from_child, session->output + session->length,
+                 session->capacity - session->length - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        session->length += n;
+    }
+}
+
+// Read output until the session waits at a menu again
+static int readUntilMenu(Session *session) {
+    return readUntilPrompt(session, NULL) == 1;
+}
+
+// Send input and wait for the next menu
+static int runCommand(Session *session, const char *input) {
+    if (session->broken || !sendInput(session, input) || !readUntilMenu(session)) {
+        session->broken = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// Wait up to timeout_ms for a process to exit. Returns 1 once it is reaped
+static int waitForExit(pid_t pid, int timeout_ms) {
+    double deadline = nowMs() + timeout_ms;
+
+    while (1) {
+        pid_t result = waitpid(pid, NULL, WNOHANG);
+
+        if (result == pid || (result < 0 && errno != EINTR)) return 1;
+        if (nowMs() >= deadline) return 0;
+        sleepMs(10);
+    }
+}
+
+// Leave the program and reap the process. A broken session may be stuck
+// (the library loops on end of input), so it is terminated, and any
+// session that does not exit in time is killed
+static void stopSession(Session *session) {
+    if (!session->broken) {
+        if (session->logged_in) {
+            sendInput(session, "6\n");
+        }
+        sendInput(session, "4\n");
+    }
+    close(session->to_child);
+    close(session->from_child);
+
+    if (session->broken || !waitForExit(session->pid, STOP_TIMEOUT_MS)) {
+        kill(session->pid, SIGTERM);
+        if (!waitForExit(session->pid, STOP_TIMEOUT_MS)) {
+            kill(session->pid, SIGKILL);
+            waitpid(session->pid, NULL, 0);
+        }
+    }
+    free(session->output);
+}
+
+// Remember the book IDs shown in a listing. Only the table rows count:
+// they run from the line after the "----" separator to the next blank line,
+// so the numbered menu printed after the table is not taken for IDs
+static void parseListing(Session *session) {
+    char *line = strstr(session->output, "\n----");
+
+    session->listed_count = 0;
+    if (line == NULL) return;
+    line = strchr(line + 1, '\n');
+
+    while (line != NULL && *++line != '\0' && *line != '\n') {
+        if (isdigit((unsigned char)*line) && session->listed_count < MAX_LISTED) {
+            session->listed[session->listed_count++] = atoi(line);
+        }
+        line = strchr(line, '\n');
+    }
+}
+
+// Forget a listed book after borrowing it
+static void removeListed(Session *session, int book_id) {
+    int i;
+
+    for (i = 0; i < session->listed_count; i++) {
+        if (session->listed[i] == book_id) {
+            session->listed[i] = session->listed[--session->listed_count];
+            return;
+        }
+    }
+}
+
+// Forget a loan after it was returned
+static void removeLoan(Session *session, int book_id) {
+    int i;
+
+    for (i = 0; i < session->loan_count; i++) {
+        if (session->loans[i] == book_id) {
+            session->loans[i] = session->loans[--session->loan_count];
+            return;
+        }
+    }
+}
+
+// Register the member. The password is only sent once it is asked for: a
+// name registered by an earlier run goes straight back to the menu, and a
+// password sent anyway would be read as a menu choice
+static void registerMember(Session *session, const char *password) {
+    char input[MAX_STRING * 2];
+
+    snprintf(input, sizeof(input), "1\n%s\n", session->username);
+    if (!sendInput(session, input)) {
+        session->broken = 1;
+        return;
+    }
+    switch (readUntilPrompt(session, PASSWORD_PROMPT)) {
+        case 1:
+            return; // already registered
+        case 2:
+            snprintf(input, sizeof(input), "%s\n", password);
+            runCommand(session, input);
+            return;
+        default:
+            session->broken = 1;
+    }
+}
+
+// Log in (logging out first if needed)
+static int doLogin(Session *session, const char *password) {
+    char input[MAX_STRING * 3];
+
+    if (session->logged_in) {
+        if (!runCommand(session, "6\n")) return OUTCOME_ERROR;
+        session->logged_in = 0;
+    }
+    snprintf(input, sizeof(input), "2\n%s\n%s\n", session->username, password);
+    if (!runCommand(session, input) || strstr(session->output, "Login successful") == NULL) {
+        return OUTCOME_ERROR;
+    }
+    session->logged_in = 1;
+    return OUTCOME_OK;
+}
+
+// Run one operation and classify its outcome
+static int runOperation(Session *session, const char *password, int op, int book_id) {
+    char input[64];
+
+    switch (op) {
+        case OP_LOGIN:
+            return doLogin(session, password);
+
+        case OP_LIST:
+            if (!runCommand(session, "2\n")) return OUTCOME_ERROR;
+            parseListing(session);
+            return OUTCOME_OK;
+
+        case OP_BORROW:
+            if (book_id <= 0) {
+                if (session->listed_count == 0) {
+                    if (!runCommand(session, "2\n")) return OUTCOME_ERROR;
+                    parseListing(session);
+                    if (session->listed_count == 0) return OUTCOME_CONFLICT;
+                }
+                book_id = session->listed[rand() % session->listed_count];
+            }
+            snprintf(input, sizeof(input), "3\n%d\n", book_id);
+            if (!runCommand(session, input)) return OUTCOME_ERROR;
+            if (strstr(session->output, "Successfully borrowed") != NULL) {
+                removeListed(session, book_id);
+                if (session->loan_count < MAX_LOANS) {
+                    session->loans[session->loan_count++] = book_id;
+                }
+                return OUTCOME_OK;
+            }
+            // Someone else borrowed it since our last listing
+            return strstr(session->output, "is not available") != NULL ? OUTCOME_CONFLICT : OUTCOME_ERROR;
+
+        case OP_RETURN:
+            if (book_id <= 0) {
+                if (session->loan_count == 0) return OUTCOME_CONFLICT;
+                book_id = session->loans[rand() % session->loan_count];
+            }
+            snprintf(input, sizeof(input), "4\n%d\n", book_id);
+            if (!runCommand(session, input)) return OUTCOME_ERROR;
+            removeLoan(session, book_id);
+            if (strstr(session->output, "Successfully returned") != NULL) {
+                return OUTCOME_OK;
+            }
+            return strstr(session->output, "haven't borrowed") != NULL ? OUTCOME_CONFLICT : OUTCOME_ERROR;
+    }
+    return OUTCOME_ERROR;
+}
+
+// Pick an operation from the weighted mix
+static int pickOperation(const Options *options) {
+    int total = 0, roll, op;
+
+    for (op = 0; op < OP_COUNT; op++) total += options->weights[op];
+    roll = rand() % total;
+    for (op = 0; op < OP_COUNT; op++) {
+        if (roll < options->weights[op]) return op;
+        roll -= options->weights[op];
+    }
+    return OP_LIST;
+}
+
+// Write samples to the coordinator
+static void reportSample(int fd, int op, int outcome, double ms) {
+    Sample sample;
+
+    sample.op = op;
+    sample.outcome = outcome;
+    sample.ms = ms;
+    if (write(fd, &sample, sizeof(sample)) != sizeof(sample)) {
+        _exit(1);
+    }
+}
+
+// Run one operation and report it. A member that is not logged in logs in
+// first; that login is timed and reported on its own, and if it fails the
+// operation is not run
+static void runAndReport(Session *session, const char *password, int op, int book_id, int fd) {
+    double start;
+    int outcome;
+
+    if (op != OP_LOGIN && !session->logged_in) {
+        start = nowMs();
+        outcome = doLogin(session, password);
+        reportSample(fd, OP_LOGIN, outcome, nowMs() - start);
+        if (outcome != OUTCOME_OK) return;
+    }
+    start = nowMs();
+    outcome = runOperation(session, password, op, book_id);
+    reportSample(fd, op, outcome, nowMs() - start);
+}
+
+// Body of one member process
+static void runMember(const Options *options, int member, const TraceEntry *trace, int trace_count, int fd) {
+    Session session;
+    char password[MAX_STRING];
+    int i;
+
+    srand(options->seed + member * 7919);
+    if (!startSession(&session, options->program)) {
+        reportSample(fd, OP_LOGIN, OUTCOME_ERROR, 0);
+        _exit(1);
+    }
+    if (!readUntilMenu(&session)) {
+        session.broken = 1;
+        stopSession(&session);
+        reportSample(fd, OP_LOGIN, OUTCOME_ERROR, 0);
+        _exit(1);
+    }
+
+    // Register (not measured); members from an earlier run already exist
+    snprintf(session.username, sizeof(session.username), "loadgen%d", member);
+    snprintf(password, sizeof(password), "pw%d", member);
+    registerMember(&session, password);
+
+    if (trace != NULL) {
+        for (i = 0; i < trace_count; i++) {
+            int op = trace[i].op;
+
+            if (trace[i].member != member) continue;
+            // Nothing to return yet: borrow instead, as the random mix does
+            if (op == OP_RETURN && trace[i].book_id <= 0 && session.loan_count == 0) op = OP_BORROW;
+            sleepMs(trace[i].think_ms >= 0 ? trace[i].think_ms : thinkTime(options->think_ms));
+            runAndReport(&session, password, op, trace[i].book_id, fd);
+        }
+    } else {
+        for (i = 0; i < options->ops; i++) {
+            int op = pickOperation(options);
+
+            if (op == OP_RETURN && session.loan_count == 0) op = OP_BORROW;
+            sleepMs(thinkTime(options->think_ms));
+            runAndReport(&session, password, op, 0, fd);
+        }
+    }
+
+    stopSession(&session);
+    _exit(0);
+}
+
+// Find "key": in a JSON line and return a pointer to its value
+static const char *jsonValue(const char *line, const char *key) {
+    char pattern[MAX_STRING];
+    const char *value;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    value = strstr(line, pattern);
+    if (value == NULL) return NULL;
+    value += strlen(pattern);
+    while (isspace((unsigned char)*value)) value++;
+    if (*value != ':') return NULL;
+    value++;
+    while (isspace((unsigned char)*value)) value++;
+    return value;
+}
+
+// Copy a JSON string value
+static int jsonString(const char *line, const char *key, char *output, size_t size) {
+    const char *value = jsonValue(line, key);
+    size_t length = 0;
+
+    if (value == NULL || *value != '"') return 0;
+    value++;
+    while (*value != '\0' && *value != '"' && length + 1 < size) {
+        if (*value == '\\' && value[1] != '\0') value++;
+        output[length++] = *value++;
+    }
+    output[length] = '\0';
+    return 1;
+}
+
+// Read a JSON number value, or fallback if missing
+static int jsonInt(const char *line, const char *key, int fallback) {
+    const char *value = jsonValue(line, key);
+    return value != NULL && (isdigit((unsigned char)*value) || *value == '-') ? atoi(value) : fallback;
+}
+
+// Load a JSON Lines trace. Each line is one operation:
+//   {"member": "alice", "op": "borrow", "book_id": 12, "think_ms": 250}
+// "op" is login, list, borrow or return; book_id and think_ms are optional.
+// Lines without a known "op" are skipped. Members are numbered in order of
+// first appearance
+static TraceEntry *loadTrace(const char *path, int *count, int *members, int *skipped) {
+    FILE *file = fopen(path, "r");
+    static char names[MAX_TRACE_MEMBERS][MAX_STRING];
+    TraceEntry *entries;
+    int capacity = 256;
+    char line[MAX_STRING * 16];
+
+    *count = 0;
+    *members = 0;
+    *skipped = 0;
+    if (file == NULL) {
+        return NULL;
+    }
+    entries = malloc(sizeof(TraceEntry) * capacity);
+    if (entries == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char op_name[MAX_STRING], member_name[MAX_STRING];
+        TraceEntry entry;
+        int i;
+
+        entry.op = -1;
+        if (jsonString(line, "op", op_name, sizeof(op_name))) {
+            for (i = 0; i < OP_COUNT; i++) {
+                if (strcmp(op_name, op_names[i]) == 0) entry.op = i;
+            }
+        }
+        if (entry.op < 0) {
+            (*skipped)++;
+            continue;
+        }
+        if (!jsonString(line, "member", member_name, sizeof(member_name))) {
+            strcpy(member_name, "member");
+        }
+
+        for (i = 0; i < *members && strcmp(names[i], member_name) != 0; i++);
+        if (i == *members) {
+            if (*members == (int)(sizeof(names) / sizeof(names[0]))) {
+                (*skipped)++;
+                continue;
+            }
+            strcpy(names[(*members)++], member_name);
+        }
+        entry.member = i;
+        entry.book_id = jsonInt(line, "book_id", 0);
+        entry.think_ms = jsonInt(line, "think_ms", -1);
+
+        if (*count == capacity) {
+            TraceEntry *grown;
+            capacity *= 2;
+            grown = realloc(entries, sizeof(TraceEntry) * capacity);
+            if (grown == NULL) break;
+            entries = grown;
+        }
+        entries[(*count)++] = entry;
+    }
+
+    fclose(file);
+    return entries;
+}
+
+// Compare latencies (for qsort)
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Latency at a percentile of sorted samples
+static double percentile(const double *sorted, int count, double p) {
+    int index = (int)(p / 100.0 * count);
+    if (count == 0) return 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+// Print one report row
+static void printRow(const char *name, double *latencies, int count, int conflicts, int errors, double elapsed_ms) {
+    qsort(latencies, count, sizeof(double), compareDouble);
+    printf("%-8s %8d %10.1f %9.2f %9.2f %9.2f %9.2f %9d %7d\n",
+           name, count, count * 1000.0 / elapsed_ms,
+           percentile(latencies, count, 50), percentile(latencies, count, 95),
+           percentile(latencies, count, 99), count ? latencies[count - 1] : 0.0,
+           conflicts, errors);
+}
+
+// A growable list of book IDs, for the consistency check
+typedef struct {
+    int *ids;
+    int count;
+    int capacity;
+} IdList;
+
+static int addId(IdList *list, int id) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 1024;
+        int *grown = realloc(list->ids, sizeof(int) * capacity);
+
+        if (grown == NULL) return 0;
+        list->ids = grown;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+    return 1;
+}
+
+// Collect the book IDs of a text data file: the first field of each line,
+// or the field after the first ';' if after_separator is set. Returns 0 if
+// out of memory; a missing file has no IDs
+static int readIds(const char *path, int after_separator, IdList *list) {
+    FILE *file = fopen(path, "r");
+    char line[MAX_STRING * 4];
+    int ok = 1;
+
+    if (file == NULL) {
+        return 1;
+    }
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        char *field = line;
+
+        if (after_separator) {
+            field = strchr(line, ';');
+            if (field == NULL) continue;
+            field++;
+        }
+        while (isspace((unsigned char)*field)) field++;
+        if (!isdigit((unsigned char)*field)) continue;
+        ok = addId(list, atoi(field));
+    }
+    fclose(file);
+    return ok;
+}
+
+// Collects IDs from a paged catalog scan
+typedef struct {
+    IdList *catalog;
+    IdList *available;
+    int ok;
+} PagedIds;
+
+static int collectPagedBook(const PagedBook *record, void *context) {
+    PagedIds *ids = (PagedIds *)context;
+
+    ids->ok = addId(ids->catalog, record->id) && (!record->available || addId(ids->available, record->id));
+    return ids->ok;
+}
+
+static int collectLoan(int book_id, void *context) {
+    return addId((IdList *)context, book_id);
+}
+
+// Read the IDs from catalog.db. Returns 0 if it can't be read
+static int readPagedIds(IdList *catalog, IdList *available, IdList *loaned) {
+    PagedStore *store = pagedOpen(PAGED_CATALOG_FILE, PAGED_MIN_POOL_PAGES, 0);
+    PagedIds ids = { catalog, available, 1 };
+    int ok;
+
+    if (store == NULL) {
+        return 0;
+    }
+    ok = pagedBegin(store, 0);
+    if (ok) {
+        pagedScan(store, INT_MIN, INT_MAX, collectPagedBook, &ids);
+        ok = ids.ok && pagedScanLoans(store, NULL, collectLoan, loaned) == loaned->count;
+        pagedEnd(store);
+    }
+    pagedClose(store);
+    return ok;
+}
+
+// Compare book IDs (for qsort)
+static int compareInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Occurrences of id at *pos in a sorted list, advancing *pos past them
+static int countId(const IdList *list, int *pos, int id) {
+    int count = 0;
+
+    while (*pos < list->count && list->ids[*pos] < id) (*pos)++;
+    while (*pos < list->count && list->ids[*pos] == id) {
+        (*pos)++;
+        count++;
+    }
+    return count;
+}
+
+// After the run, check that every book in the catalog is either available
+// or loaned, exactly once, in catalog.db if it exists or else in the text
+// files. Prints the totals and returns 1 if nothing was lost or duplicated
+static int checkBooks() {
+    IdList catalog = {NULL, 0, 0}, available = {NULL, 0, 0}, loaned = {NULL, 0, 0};
+    int lost = 0, duplicated = 0, unknown, books = 0, matched = 0;
+    int i, a = 0, l = 0, ok;
+    FILE *file = fopen(PAGED_CATALOG_FILE, "rb");
+
+    if (file != NULL) {
+        fclose(file);
+        ok = readPagedIds(&catalog, &available, &loaned);
+    } else {
+        ok = readIds(BOOKS_FILE, 0, &catalog) && readIds(AVAILABLE_BOOKS_FILE, 0, &available) &&
+             readIds(BORROWED_BOOKS_FILE, 1, &loaned);
+    }
+    if (!ok) {
+        printf("\nError: Cannot read the book data to check it!\n");
+        free(catalog.ids);
+        free(available.ids);
+        free(loaned.ids);
+        return 0;
+    }
+
+    qsort(catalog.ids, catalog.count, sizeof(int), compareInt);
+    qsort(available.ids, available.count, sizeof(int), compareInt);
+    qsort(loaned.ids, loaned.count, sizeof(int), compareInt);
+    for (i = 0; i < catalog.count; i++) {
+        int copies;
+
+        if (i > 0 && catalog.ids[i] == catalog.ids[i - 1]) continue;
+        books++;
+        copies = countId(&available, &a, catalog.ids[i]) + countId(&loaned, &l, catalog.ids[i]);
+        if (copies == 0) lost++;
+        if (copies > 1) duplicated++;
+        matched += copies;
+    }
+    // Entries no catalog book accounted for
+    unknown = available.count + loaned.count - matched;
+
+    printf("\nBooks (%s): %d in catalog, %d available, %d loaned\n",
+           file != NULL ? PAGED_CATALOG_FILE : "text files", books, available.count, loaned.count);
+    printf("Lost: %d, duplicated: %d, not in catalog: %d\n", lost, duplicated, unknown);
+
+    free(catalog.ids);
+    free(available.ids);
+    free(loaned.ids);
+    return lost == 0 && duplicated == 0 && unknown == 0;
+}
+
+// Parse "L:S:B:R" mix weights
+static int parseMix(const char *text, int weights[]) {
+    int total = 0, op;
+
+    if (sscanf(text, "%d:%d:%d:%d", &weights[0], &weights[1], &weights[2], &weights[3]) != OP_COUNT) {
+        return 0;
+    }
+    for (op = 0; op < OP_COUNT; op++) {
+        if (weights[op] < 0) return 0;
+        total += weights[op];
+    }
+    return total > 0;
+}
+
+// Main function
+int main(int argc, char *argv[]) {
+    Options options;
+    TraceEntry *trace = NULL;
+    int trace_count = 0, skipped = 0;
+    int *pipes;
+    pid_t *pids;
+    struct pollfd *polled;
+    int running, consistent;
+    double *latencies[OP_COUNT + 1];
+    int counts[OP_COUNT + 1] = {0}, conflicts[OP_COUNT + 1] = {0}, errors[OP_COUNT + 1] = {0};
+    int capacities[OP_COUNT + 1];
+    double start, elapsed;
+    int i, op;
+
+    options.members = 8;
+    options.ops = 200;
+    options.weights[OP_LOGIN] = 1;
+    options.weights[OP_LIST] = 4;
+    options.weights[OP_BORROW] = 3;
+    options.weights[OP_RETURN] = 2;
+    options.think_ms = 0;
+    options.trace_path = NULL;
+    options.directory = NULL;
+    options.seed = (unsigned int)time(NULL);
+    strcpy(options.program, "./library");
+
+    for (i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) {
+            fprintf(stderr, "Error: Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-n") == 0) options.members = atoi(value);
+        else if (strcmp(argv[i], "-o") == 0) options.ops = atoi(value);
+        else if (strcmp(argv[i], "-t") == 0) options.think_ms = atoi(value);
+        else if (strcmp(argv[i], "-r") == 0) options.trace_path = value;
+        else if (strcmp(argv[i], "-C") == 0) options.directory = value;
+        else if (strcmp(argv[i], "-s") == 0) options.seed = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-p") == 0) {
+            if (strlen(value) >= sizeof(options.program)) return 1;
+            strcpy(options.program, value);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (!parseMix(value, options.weights)) {
+                fprintf(stderr, "Error: Invalid mix '%s' (expected login:list:borrow:return)\n", value);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    if (options.members <= 0 || options.ops < 0) {
+        fprintf(stderr, "Error: Invalid member or operation count!\n");
+        return 1;
+    }
+
+    // Resolve the program before changing directory
+    if (options.program[0] != '/') {
+        char resolved[PATH_MAX];
+        if (realpath(options.program, resolved) == NULL) {
+            fprintf(stderr, "Error: Cannot find %s\n", options.program);
+            return 1;
+        }
+        strcpy(options.program, resolved);
+    }
+    if (options.trace_path != NULL) {
+        int trace_members;
+        trace = loadTrace(options.trace_path, &trace_count, &trace_members, &skipped);
+        if (trace == NULL) {
+            fprintf(stderr, "Error: Cannot read trace %s\n", options.trace_path);
+            return 1;
+        }
+        if (trace_count == 0) {
+            fprintf(stderr, "Error: Trace %s has no operations (%d lines skipped)\n", options.trace_path, skipped);
+            return 1;
+        }
+        options.members = trace_members;
+    }
+    if (options.directory != NULL && chdir(options.directory) != 0) {
+        fprintf(stderr, "Error: Cannot change to %s\n", options.directory);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pipes = malloc(sizeof(int) * options.members);
+    pids = malloc(sizeof(pid_t) * options.members);
+    polled = malloc(sizeof(struct pollfd) * options.members);
+    if (pipes == NULL || pids == NULL || polled == NULL) {
+        fprintf(stderr, "Error: Out of memory!\n");
+        return 1;
+    }
+    for (op = 0; op <= OP_COUNT; op++) {
+        capacities[op] = 1024;
+        latencies[op] = malloc(sizeof(double) * capacities[op]);
+    }
+
+    printf("Running %d members (%s) against %s\n", options.members,
+           trace != NULL ? "trace replay" : "random mix", options.program);
+    if (skipped > 0) {
+        printf("Skipped %d trace lines without a known \"op\"\n", skipped);
+    }
+    fflush(stdout);
+
+    start = nowMs();
+    for (i = 0; i < options.members; i++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fprintf(stderr, "Error: Cannot create pipe!\n");
+            return 1;
+        }
+        // Keep the sample pipe out of the ./library processes, or the
+        // coordinator would wait for them to exit instead of the member
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            close(fds[0]);
+            runMember(&options, i, trace, trace_count, fds[1]);
+        }
+        close(fds[1]);
+        pipes[i] = fds[0];
+    }
+
+    // Collect samples from all members as they arrive; "all" is accumulated
+    // in the extra slot. Reading one member to the end before the next would
+    // leave the others blocked on a full pipe. Each sample is one write of
+    // less than PIPE_BUF bytes, so a read never returns part of one
+    for (i = 0; i < options.members; i++) {
+        polled[i].fd = pipes[i];
+        polled[i].events = POLLIN;
+    }
+    running = options.members;
+    while (running > 0) {
+        if (poll(polled, options.members, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: Cannot wait for members!\n");
+            return 1;
+        }
+        for (i = 0; i < options.members; i++) {
+            Sample sample;
+            int slots[2];
+            int s;
+
+            if (polled[i].fd < 0 || polled[i].revents == 0) continue;
+            if (read(pipes[i], &sample, sizeof(sample)) != sizeof(sample)) {
+                // End of the member's samples
+                close(pipes[i]);
+                waitpid(pids[i], NULL, 0);
+                polled[i].fd = -1;
+                running--;
+                continue;
+            }
+
+            slots[0] = sample.op;
+            slots[1] = OP_COUNT;
+            for (s = 0; s < 2; s++) {
+                op = slots[s];
+                if (counts[op] == capacities[op]) {
+                    capacities[op] *= 2;
+                    latencies[op] = realloc(latencies[op], sizeof(double) * capacities[op]);
+                    if (latencies[op] == NULL) return 1;
+                }
+                latencies[op][counts[op]++] = sample.ms;
+                if (sample.outcome == OUTCOME_CONFLICT) conflicts[op]++;
+                if (sample.outcome == OUTCOME_ERROR) errors[op]++;
+            }
+        }
+    }
+    elapsed = nowMs() - start;
+
+    printf("\nElapsed: %.2f s\n\n", elapsed / 1000.0);
+    printf("%-8s %8s %10s %9s %9s %9s %9s %9s %7s\n",
+           "op", "count", "ops/s", "p50 ms", "p95 ms", "p99 ms", "max ms", "conflicts", "errors");
+    printf("----------------------------------------------------------------------------------------\n");
+    for (op = 0; op < OP_COUNT; op++) {
+        printRow(op_names[op], latencies[op], counts[op], conflicts[op], errors[op], elapsed);
+    }
+    printRow("all", latencies[OP_COUNT], counts[OP_COUNT], conflicts[OP_COUNT], errors[OP_COUNT], elapsed);
+    consistent = checkBooks();
+
+    for (op = 0; op <= OP_COUNT; op++) {
+        free(latencies[op]);
+    }
+    free(pipes);
+    free(pids);
+    free(polled);
+    free(trace);
+    return errors[OP_COUNT] > 0 || !consistent;
+}
@@ -0,0 +1,1121 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include "library.h"
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Paged catalog storage: B+trees stored in fixed-size pages, accessed
+// through a buffer pool with CLOCK replacement. One tree holds the books
+// keyed on ID, a second holds the loans keyed on (username, book ID) so a
+// member's loans are found without scanning the catalog. Only the pages on
+// the path to a record are read, so memory use is bounded by the pool size
+// whatever the size of the catalog.
+//
+// Book records are fixed 24-byte entries; titles and authors live in heap
+// pages and are referenced by page and offset. Authors are stored once per
+// name. Who borrowed a book is only recorded in the loan tree.
+//
+// Several processes can share one file: each operation runs between
+// pagedBegin and pagedEnd, which hold a read or write lock on the file. A
+// writer bumps the header's generation, and a process that finds a new
+// generation when it takes the lock drops the pages it has cached.
+
+#define STORE_MAGIC "LIBPAGE4"
+
+// Page 0 of the file
+typedef struct {
+    char magic[8];
+    uint32_t page_size;
+    uint32_t root;          // book tree, 0 while empty
+    uint32_t page_count;
+    uint32_t record_count;
+    uint32_t loan_root;     // loan tree, 0 while empty
+    uint32_t loan_count;
+    uint32_t generation;    // bumped by every write operation
+    uint32_t heap_page;     // heap page new strings go to, 0 if none yet
+    uint32_t heap_used;     // bytes used in heap_page
+} StoreHeader;
+
+// First bytes of every tree page
+typedef struct {
+    uint32_t is_leaf;
+    uint32_t count;
+    uint32_t next;          // next leaf in key order, 0 if none
+    uint32_t reserved;
+} NodeHeader;
+
+// A string in a heap page. Strings never span pages
+typedef struct {
+    uint32_t page;
+    uint16_t offset;
+    uint16_t length;
+} StringRef;
+
+// Book record as stored in the book tree; the key is the ID
+typedef struct {
+    int32_t id;
+    int32_t available;
+    StringRef title;
+    StringRef author;
+} StoredBook;
+
+// Loan record: the whole record is the key, ordered by username then book
+// ID, so one user's loans are adjacent in the tree
+typedef struct {
+    char username[MAX_STRING];
+    int book_id;
+} PagedLoan;
+
+// Layout of one tree. The key is the first key_size bytes of a record
+typedef struct {
+    size_t record_size;
+    size_t key_size;
+    int (*compare)(const void *a, const void *b);
+} TreeKind;
+
+// A tree in the store: its kind and where its root and size are kept
+typedef struct {
+    const TreeKind *kind;
+    uint32_t *root;
+    uint32_t *count;
+} Tree;
+
+// Largest key of any tree, for split buffers
+#define MAX_KEY_SIZE sizeof(PagedLoan)
+
+#define NODE(data) ((NodeHeader *)(data))
+
+// Author dictionary slot: a stored name with its hash, length 0xFFFF if empty
+typedef struct {
+    uint32_t hash;
+    StringRef ref;
+} NameSlot;
+
+// One buffer pool slot
+typedef struct {
+    uint32_t page_no;
+    int valid;
+    int dirty;
+    int pins;
+    int referenced;
+    int next_in_bucket;     // hash chain, -1 at the end
+    unsigned char *data;
+} Frame;
+
+struct PagedStore {
+    FILE *file;
+    StoreHeader header;
+    int header_dirty;
+    Frame *frames;
+    unsigned char *pool;    // frame_count pages, frame i at pool + i * PAGE_SIZE
+    int frame_count;
+    int clock_hand;
+    int *buckets;           // page number hash -> first frame, -1 if empty
+    int bucket_count;
+    int locked;             // inside pagedBegin / pagedEnd
+    int writing;
+    NameSlot *names;        // authors already in the heap, for reuse
+    int name_slots;         // power of two, 0 until the first author
+    int name_count;
+};
+
+// Seek to the start of a page. Offsets are 64-bit: the file passes 2 GB at
+// a few million books, and long is 32 bits on Windows
+static int seekPage(PagedStore *store, uint32_t page_no) {
+#ifdef _WIN32
+    return _fseeki64(store->file, (__int64)page_no * PAGE_SIZE, SEEK_SET) == 0;
+#else
+    return fseeko(store->file, (off_t)page_no * PAGE_SIZE, SEEK_SET) == 0;
+#endif
+}
+
+// Write a page to its place in the file
+static int writePage(PagedStore *store, uint32_t page_no, const unsigned char *data) {
+    if (!seekPage(store, page_no)) {
+        return 0;
+    }
+    return fwrite(data, PAGE_SIZE, 1, store->file) == 1;
+}
+
+// Remove a frame from the page number hash
+static void unhashFrame(PagedStore *store, int index) {
+    int *link = &store->buckets[store->frames[index].page_no % store->bucket_count];
+
+    while (*link != -1) {
+        if (*link == index) {
+            *link = store->frames[index].next_in_bucket;
+            return;
+        }
+        link = &store->frames[*link].next_in_bucket;
+    }
+}
+
+// Pick a frame to reuse with the CLOCK algorithm, writing it back if dirty
+static int evictFrame(PagedStore *store) {
+    int scanned;
+
+    // Two full turns: the first may only clear reference bits
+    for (scanned = 0; scanned < store->frame_count * 2; scanned++) {
+        int index = store->clock_hand;
+        Frame *frame = &store->frames[index];
+
+        store->clock_hand = (store->clock_hand + 1) % store->frame_count;
+        if (frame->pins > 0) continue;
+        if (frame->valid && frame->referenced) {
+            frame->referenced = 0;
+            continue;
+        }
+
+        if (frame->valid) {
+            if (frame->dirty && !writePage(store, frame->page_no, frame->data)) {
+                return -1;
+            }
+            unhashFrame(store, index);
+            frame->valid = 0;
+            frame->dirty = 0;
+        }
+        return index;
+    }
+
+    return -1; // every frame is pinned
+}
+
+// Put a page into a free frame and pin it
+static int claimFrame(PagedStore *store, uint32_t page_no) {
+    int index = evictFrame(store);
+    Frame *frame;
+
+    if (index < 0) {
+        return -1;
+    }
+    frame = &store->frames[index];
+    frame->page_no = page_no;
+    frame->valid = 1;
+    frame->pins = 1;
+    frame->referenced = 1;
+    frame->next_in_bucket = store->buckets[page_no % store->bucket_count];
+    store->buckets[page_no % store->bucket_count] = index;
+    return index;
+}
+
+// Pin a page in the buffer pool, reading it from disk if needed
+static unsigned char *fetchPage(PagedStore *store, uint32_t page_no) {
+    int index = store->buckets[page_no % store->bucket_count];
+
+    while (index != -1) {
+        Frame *frame = &store->frames[index];
+        if (frame->page_no == page_no) {
+            frame->pins++;
+            frame->referenced = 1;
+            return frame->data;
+        }
+        index = frame->next_in_bucket;
+    }
+
+    index = claimFrame(store, page_no);
+    if (index < 0) {
+        return NULL;
+    }
+    if (!seekPage(store, page_no) ||
+        fread(store->frames[index].data, PAGE_SIZE, 1, store->file) != 1) {
+        store->frames[index].pins = 0;
+        unhashFrame(store, index);
+        store->frames[index].valid = 0;
+        return NULL;
+    }
+    return store->frames[index].data;
+}
+
+// Release a page pinned by fetchPage or allocatePage
+static void unpinPage(PagedStore *store, unsigned char *data, int dirty) {
+    Frame *frame = &store->frames[(data - store->pool) / PAGE_SIZE];
+
+    frame->pins--;
+    if (dirty) frame->dirty = 1;
+}
+
+// Append a new zeroed page to the file and pin it
+static unsigned char *allocatePage(PagedStore *store, uint32_t *page_no, int is_leaf) {
+    int index = claimFrame(store, store->header.page_count);
+    unsigned char *data;
+
+    if (index < 0) {
+        return NULL;
+    }
+    *page_no = store->header.page_count++;
+    store->header_dirty = 1;
+
+    data = store->frames[index].data;
+    memset(data, 0, PAGE_SIZE);
+    NODE(data)->is_leaf = is_leaf;
+    store->frames[index].dirty = 1;
+    return data;
+}
+
+// Take (F_RDLCK / F_WRLCK) or release (F_UNLCK) the lock on the whole file,
+// waiting for other processes. Not available on Windows, where only one
+// process may use the file at a time
+static int lockStore(PagedStore *store, short type) {
+#ifndef _WIN32
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fileno(store->file), F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+#else
+    (void)store;
+    (void)type;
+#endif
+    return 1;
+}
+
+// Read the header from disk
+static int readHeader(PagedStore *store, StoreHeader *header) {
+    return seekPage(store, 0) && fread(header, sizeof(StoreHeader), 1, store->file) == 1 &&
+           memcmp(header->magic, STORE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->page_size == PAGE_SIZE;
+}
+
+// Forget every cached page (none may be pinned or dirty)
+static void dropFrames(PagedStore *store) {
+    int i;
+
+    for (i = 0; i < store->frame_count; i++) {
+        store->frames[i].valid = 0;
+        store->frames[i].dirty = 0;
+        store->frames[i].next_in_bucket = -1;
+    }
+    for (i = 0; i < store->bucket_count; i++) {
+        store->buckets[i] = -1;
+    }
+    store->header_dirty = 0;
+
+    // Names written by a failed operation may not be on disk
+    free(store->names);
+    store->names = NULL;
+    store->name_slots = 0;
+    store->name_count = 0;
+}
+
+// Open a paged catalog, or create an empty one. pool_pages is the buffer
+// pool budget in pages of PAGE_SIZE bytes
+PagedStore *pagedOpen(const char *path, int pool_pages, int create) {
+    PagedStore *store;
+    int i;
+
+    if (pool_pages < PAGED_MIN_POOL_PAGES) {
+        pool_pages = PAGED_MIN_POOL_PAGES;
+    }
+
+    store = calloc(1, sizeof(PagedStore));
+    if (store == NULL) {
+        return NULL;
+    }
+
+    store->file = fopen(path, create ? "w+b" : "r+b");
+    if (store->file == NULL) {
+        free(store);
+        return NULL;
+    }
+    // Pages are read and written whole; a stdio buffer would only hide
+    // other processes' writes
+    setvbuf(store->file, NULL, _IONBF, 0);
+
+    if (create) {
+        memcpy(store->header.magic, STORE_MAGIC, sizeof(store->header.magic));
+        store->header.page_size = PAGE_SIZE;
+        store->header.page_count = 1;
+        store->header_dirty = 1;
+    } else {
+        int ok = lockStore(store, F_RDLCK) && readHeader(store, &store->header);
+
+        lockStore(store, F_UNLCK);
+        if (!ok) {
+            fclose(store->file);
+            free(store);
+            return NULL;
+        }
+    }
+
+    store->frame_count = pool_pages;
+    store->bucket_count = pool_pages * 2 + 1;
+    store->frames = calloc(pool_pages, sizeof(Frame));
+    store->buckets = malloc(sizeof(int) * store->bucket_count);
+    store->pool = malloc((size_t)PAGE_SIZE * pool_pages);
+    if (store->frames == NULL || store->buckets == NULL || store->pool == NULL) {
+        pagedClose(store);
+        return NULL;
+    }
+    for (i = 0; i < store->bucket_count; i++) {
+        store->buckets[i] = -1;
+    }
+    for (i = 0; i < pool_pages; i++) {
+        store->frames[i].next_in_bucket = -1;
+        store->frames[i].data = store->pool + (size_t)PAGE_SIZE * i;
+    }
+
+    if (create && !pagedFlush(store)) {
+        pagedClose(store);
+        return NULL;
+    }
+    return store;
+}
+
+// Write all dirty pages and the header to disk
+int pagedFlush(PagedStore *store) {
+    int i;
+
+    for (i = 0; i < store->frame_count; i++) {
+        Frame *frame = &store->frames[i];
+        if (frame->valid && frame->dirty) {
+            if (!writePage(store, frame->page_no, frame->data)) {
+                return 0;
+            }
+            frame->dirty = 0;
+        }
+    }
+
+    if (store->header_dirty) {
+        unsigned char page[PAGE_SIZE];
+
+        memset(page, 0, PAGE_SIZE);
+        memcpy(page, &store->header, sizeof(StoreHeader));
+        if (!writePage(store, 0, page)) {
+            return 0;
+        }
+        store->header_dirty = 0;
+    }
+    return fflush(store->file) == 0;
+}
+
+// Start an operation on a shared catalog: lock the file for reading or
+// writing, and pick up changes other processes made since the last one.
+// Returns 0 if the file can't be locked or read
+int pagedBegin(PagedStore *store, int write) {
+    StoreHeader header;
+
+    if (!lockStore(store, write ? F_WRLCK : F_RDLCK)) {
+        return 0;
+    }
+    if (!readHeader(store, &header)) {
+        lockStore(store, F_UNLCK);
+        return 0;
+    }
+    if (header.generation != store->header.generation) {
+        dropFrames(store);
+    }
+    store->header = header;
+    store->locked = 1;
+    store->writing = write;
+    return 1;
+}
+
+// Finish an operation: write its changes under a new generation and unlock.
+// Returns 0 if the changes could not be written; they are then dropped
+int pagedEnd(PagedStore *store) {
+    int ok = 1;
+    int i;
+
+    if (!store->locked) {
+        return 0;
+    }
+    if (store->writing) {
+        int changed = store->header_dirty;
+
+        for (i = 0; i < store->frame_count; i++) {
+            if (store->frames[i].valid && store->frames[i].dirty) changed = 1;
+        }
+        if (changed) {
+            store->header.generation++;
+            store->header_dirty = 1;
+            ok = pagedFlush(store);
+        }
+        if (!ok) {
+            dropFrames(store);
+        }
+    }
+    lockStore(store, F_UNLCK);
+    store->locked = 0;
+    store->writing = 0;
+    return ok;
+}
+
+// Flush and release a paged catalog
+void pagedClose(PagedStore *store) {
+    if (store == NULL) {
+        return;
+    }
+    if (store->frames != NULL && store->buckets != NULL && store->pool != NULL) {
+        pagedFlush(store);
+    }
+    free(store->pool);
+    free(store->frames);
+    free(store->buckets);
+    free(store->names);
+    fclose(store->file);
+    free(store);
+}
+
+// Compare book keys (the ID)
+static int compareBookKey(const void *a, const void *b) {
+    int left = *(const int *)a;
+    int right = *(const int *)b;
+
+    return (left > right) - (left < right);
+}
+
+// Compare loan keys (username, then book ID)
+static int compareLoanKey(const void *a, const void *b) {
+    const PagedLoan *left = (const PagedLoan *)a;
+    const PagedLoan *right = (const PagedLoan *)b;
+    int result = strcmp(left->username, right->username);
+
+    if (result != 0) return result;
+    return (left->book_id > right->book_id) - (left->book_id < right->book_id);
+}
+
+static const TreeKind book_kind = { sizeof(StoredBook), sizeof(int32_t), compareBookKey };
+static const TreeKind loan_kind = { sizeof(PagedLoan), sizeof(PagedLoan), compareLoanKey };
+
+static Tree bookTree(PagedStore *store) {
+    Tree tree = { &book_kind, &store->header.root, &store->header.record_count };
+    return tree;
+}
+
+static Tree loanTree(PagedStore *store) {
+    Tree tree = { &loan_kind, &store->header.loan_root, &store->header.loan_count };
+    return tree;
+}
+
+// Records per leaf page
+static int leafCapacity(const TreeKind *kind) {
+    return (int)((PAGE_SIZE - sizeof(NodeHeader)) / kind->record_size);
+}
+
+// Keys per internal page (one child more than keys)
+static int internalCapacity(const TreeKind *kind) {
+    return (int)((PAGE_SIZE - sizeof(NodeHeader) - sizeof(uint32_t)) /
+                 (kind->key_size + sizeof(uint32_t)));
+}
+
+// Leaf pages: records in key order after the node header
+static unsigned char *leafRecord(const TreeKind *kind, unsigned char *data, int index) {
+    return data + sizeof(NodeHeader) + kind->record_size * index;
+}
+
+// Internal pages: keys[i] is the smallest key in children[i + 1]
+static unsigned char *internalKey(const TreeKind *kind, unsigned char *data, int index) {
+    return data + sizeof(NodeHeader) + kind->key_size * index;
+}
+
+static uint32_t *internalChildren(const TreeKind *kind, unsigned char *data) {
+    return (uint32_t *)(data + sizeof(NodeHeader) + kind->key_size * internalCapacity(kind));
+}
+
+// Number of records in the paged catalog
+int pagedCount(PagedStore *store) {
+    return (int)store->header.record_count;
+}
+
+// Index of the child of an internal page that covers key
+static int childIndex(const TreeKind *kind, unsigned char *data, const void *key) {
+    int low = 0;
+    int high = NODE(data)->count;
+
+    // Number of keys <= key
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (kind->compare(internalKey(kind, data, mid), key) <= 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Index of the first record in a leaf with a key >= key
+static int leafPosition(const TreeKind *kind, unsigned char *data, const void *key) {
+    int low = 0;
+    int high = NODE(data)->count;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (kind->compare(leafRecord(kind, data, mid), key) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Walk from the root to the leaf that covers key and return it pinned
+static unsigned char *findLeaf(PagedStore *store, const Tree *tree, const void *key) {
+    unsigned char *data;
+
+    if (*tree->root == 0) {
+        return NULL;
+    }
+    data = fetchPage(store, *tree->root);
+    while (data != NULL && !NODE(data)->is_leaf) {
+        uint32_t child = internalChildren(tree->kind, data)[childIndex(tree->kind, data, key)];
+        unpinPage(store, data, 0);
+        data = fetchPage(store, child);
+    }
+    return data;
+}
+
+// Point lookup by key. Copies the record and returns 1 if found
+static int treeLookup(PagedStore *store, const Tree *tree, const void *key, void *record) {
+    const TreeKind *kind = tree->kind;
+    unsigned char *leaf = findLeaf(store, tree, key);
+    int pos;
+    int found = 0;
+
+    if (leaf == NULL) {
+        return 0;
+    }
+    pos = leafPosition(kind, leaf, key);
+    if (pos < (int)NODE(leaf)->count && kind->compare(leafRecord(kind, leaf, pos), key) == 0) {
+        memcpy(record, leafRecord(kind, leaf, pos), kind->record_size);
+        found = 1;
+    }
+    unpinPage(store, leaf, 0);
+    return found;
+}
+
+// Insert into a leaf, splitting it if full
+static int insertIntoLeaf(PagedStore *store, const Tree *tree, unsigned char *leaf, const void *record,
+                          unsigned char *split_key, uint32_t *split_page) {
+    const TreeKind *kind = tree->kind;
+    NodeHeader *node = NODE(leaf);
+    size_t size = kind->record_size;
+    int pos = leafPosition(kind, leaf, record);
+
+    // Existing record: update in place
+    if (pos < (int)node->count && kind->compare(leafRecord(kind, leaf, pos), record) == 0) {
+        memcpy(leafRecord(kind, leaf, pos), record, size);
+        return 1;
+    }
+
+    (*tree->count)++;
+    store->header_dirty = 1;
+
+    if ((int)node->count < leafCapacity(kind)) {
+        memmove(leafRecord(kind, leaf, pos + 1), leafRecord(kind, leaf, pos), size * (node->count - pos));
+        memcpy(leafRecord(kind, leaf, pos), record, size);
+        node->count++;
+        return 1;
+    }
+
+    // Full: move the upper half (after inserting) to a new right sibling.
+    // Appending past the last leaf (a build in key order) leaves the full
+    // leaf as it is instead, so sorted input packs leaves full
+    {
+        unsigned char all[PAGE_SIZE * 2];
+        int total = node->count + 1;
+        int left_count = (pos == (int)node->count && node->next == 0) ? (int)node->count : total / 2;
+        uint32_t right_no;
+        unsigned char *right = allocatePage(store, &right_no, 1);
+
+        if (right == NULL) {
+            (*tree->count)--;
+            return 0;
+        }
+        memcpy(all, leafRecord(kind, leaf, 0), size * pos);
+        memcpy(all + size * pos, record, size);
+        memcpy(all + size * (pos + 1), leafRecord(kind, leaf, pos), size * (node->count - pos));
+
+        memcpy(leafRecord(kind, leaf, 0), all, size * left_count);
+        node->count = left_count;
+        memcpy(leafRecord(kind, right, 0), all + size * left_count, size * (total - left_count));
+        NODE(right)->count = total - left_count;
+        NODE(right)->next = node->next;
+        node->next = right_no;
+
+        memcpy(split_key, leafRecord(kind, right, 0), kind->key_size);
+        *split_page = right_no;
+        unpinPage(store, right, 1);
+    }
+    return 1;
+}
+
+// Add a separator key and right child to an internal page, splitting it if full
+static int insertIntoInternal(PagedStore *store, const Tree *tree, unsigned char *data, int index,
+                              const unsigned char *key, uint32_t child,
+                              unsigned char *split_key, uint32_t *split_page) {
+    const TreeKind *kind = tree->kind;
+    NodeHeader *node = NODE(data);
+    size_t size = kind->key_size;
+    uint32_t *children = internalChildren(kind, data);
+
+    if ((int)node->count < internalCapacity(kind)) {
+        memmove(internalKey(kind, data, index + 1), internalKey(kind, data, index), size * (node->count - index));
+        memmove(&children[index + 2], &children[index + 1], sizeof(uint32_t) * (node->count - index));
+        memcpy(internalKey(kind, data, index), key, size);
+        children[index + 1] = child;
+        node->count++;
+        return 1;
+    }
+
+    // Full: the middle key moves up, keys after it go to a new right sibling
+    {
+        unsigned char all_keys[PAGE_SIZE + MAX_KEY_SIZE];
+        uint32_t all_children[PAGE_SIZE / sizeof(uint32_t) + 2];
+        int total = node->count + 1;
+        int mid = total / 2;
+        uint32_t right_no;
+        unsigned char *right = allocatePage(store, &right_no, 0);
+
+        if (right == NULL) {
+            return 0;
+        }
+        memcpy(all_keys, internalKey(kind, data, 0), size * index);
+        memcpy(all_keys + size * index, key, size);
+        memcpy(all_keys + size * (index + 1), internalKey(kind, data, index), size * (node->count - index));
+        memcpy(all_children, children, sizeof(uint32_t) * (index + 1));
+        all_children[index + 1] = child;
+        memcpy(&all_children[index + 2], &children[index + 1], sizeof(uint32_t) * (node->count - index));
+
+        memcpy(internalKey(kind, data, 0), all_keys, size * mid);
+        memcpy(children, all_children, sizeof(uint32_t) * (mid + 1));
+        node->count = mid;
+
+        memcpy(internalKey(kind, right, 0), all_keys + size * (mid + 1), size * (total - mid - 1));
+        memcpy(internalChildren(kind, right), &all_children[mid + 1], sizeof(uint32_t) * (total - mid));
+        NODE(right)->count = total - mid - 1;
+
+        memcpy(split_key, all_keys + size * mid, size);
+        *split_page = right_no;
+        unpinPage(store, right, 1);
+    }
+    return 1;
+}
+
+// Insert below page_no. If the page splits, *split_page is set to the new
+// right sibling and split_key to the smallest key under it
+static int insertRecursive(PagedStore *store, const Tree *tree, uint32_t page_no, const void *record,
+                           unsigned char *split_key, uint32_t *split_page) {
+    unsigned char *data = fetchPage(store, page_no);
+    int changed = 0;
+    int ok;
+
+    if (data == NULL) {
+        return 0;
+    }
+    *split_page = 0;
+
+    if (NODE(data)->is_leaf) {
+        ok = insertIntoLeaf(store, tree, data, record, split_key, split_page);
+        changed = ok;
+    } else {
+        int index = childIndex(tree->kind, data, record);
+        unsigned char child_key[MAX_KEY_SIZE];
+        uint32_t child_split = 0;
+
+        ok = insertRecursive(store, tree, internalChildren(tree->kind, data)[index], record,
+                             child_key, &child_split);
+        if (ok && child_split != 0) {
+            ok = insertIntoInternal(store, tree, data, index, child_key, child_split, split_key, split_page);
+            changed = ok;
+        }
+    }
+
+    // Internal pages only change when a child split
+    unpinPage(store, data, changed);
+    return ok;
+}
+
+// Insert a record, or update it in place if its key already exists
+static int treePut(PagedStore *store, const Tree *tree, const void *record) {
+    unsigned char split_key[MAX_KEY_SIZE];
+    uint32_t split_page;
+
+    if (*tree->root == 0) {
+        uint32_t root_no;
+        unsigned char *root = allocatePage(store, &root_no, 1);
+
+        if (root == NULL) {
+            return 0;
+        }
+        *tree->root = root_no;
+        unpinPage(store, root, 1);
+    }
+
+    if (!insertRecursive(store, tree, *tree->root, record, split_key, &split_page)) {
+        return 0;
+    }
+
+    // Root split: the tree grows by one level
+    if (split_page != 0) {
+        uint32_t root_no;
+        unsigned char *root = allocatePage(store, &root_no, 0);
+
+        if (root == NULL) {
+            return 0;
+        }
+        NODE(root)->count = 1;
+        memcpy(internalKey(tree->kind, root, 0), split_key, tree->kind->key_size);
+        internalChildren(tree->kind, root)[0] = *tree->root;
+        internalChildren(tree->kind, root)[1] = split_page;
+        *tree->root = root_no;
+        unpinPage(store, root, 1);
+    }
+    return 1;
+}
+
+// Remove a record by key. Leaves are not merged: an emptied leaf stays in
+// the chain and separators stay valid, so lookups and scans are unaffected.
+// Returns 1 if the record existed
+static int treeDelete(PagedStore *store, const Tree *tree, const void *key) {
+    const TreeKind *kind = tree->kind;
+    unsigned char *leaf = findLeaf(store, tree, key);
+    NodeHeader *node;
+    int pos;
+
+    if (leaf == NULL) {
+        return 0;
+    }
+    node = NODE(leaf);
+    pos = leafPosition(kind, leaf, key);
+    if (pos >= (int)node->count || kind->compare(leafRecord(kind, leaf, pos), key) != 0) {
+        unpinPage(store, leaf, 0);
+        return 0;
+    }
+    memmove(leafRecord(kind, leaf, pos), leafRecord(kind, leaf, pos + 1),
+            kind->record_size * (node->count - pos - 1));
+    node->count--;
+    (*tree->count)--;
+    store->header_dirty = 1;
+    unpinPage(store, leaf, 1);
+    return 1;
+}
+
+// Visit records with from <= key <= to in key order. Stops early when
+// visit returns 0. Returns the number of records visited
+static int treeScan(PagedStore *store, const Tree *tree, const void *from, const void *to,
+                    int (*visit)(const void *record, void *context), void *context) {
+    const TreeKind *kind = tree->kind;
+    unsigned char *leaf = findLeaf(store, tree, from);
+    int pos;
+    int visited = 0;
+
+    if (leaf == NULL) {
+        return 0;
+    }
+    pos = leafPosition(kind, leaf, from);
+
+    while (leaf != NULL) {
+        uint32_t next = NODE(leaf)->next;
+
+        for (; pos < (int)NODE(leaf)->count; pos++) {
+            const unsigned char *record = leafRecord(kind, leaf, pos);
+
+            if (kind->compare(record, to) > 0) {
+                unpinPage(store, leaf, 0);
+                return visited;
+            }
+            visited++;
+            if (!visit(record, context)) {
+                unpinPage(store, leaf, 0);
+                return visited;
+            }
+        }
+
+        unpinPage(store, leaf, 0);
+        leaf = next != 0 ? fetchPage(store, next) : NULL;
+        pos = 0;
+    }
+    return visited;
+}
+
+// Append a string to the heap, starting a new heap page when it does not
+// fit in the current one. Longer strings are cut to MAX_STRING - 1 bytes
+static int writeString(PagedStore *store, const char *text, StringRef *ref) {
+    size_t length = strlen(text);
+    unsigned char *data;
+
+    if (length >= MAX_STRING) {
+        length = MAX_STRING - 1;
+    }
+    if (store->header.heap_page == 0 || store->header.heap_used + length > PAGE_SIZE) {
+        data = allocatePage(store, &store->header.heap_page, 0);
+        store->header.heap_used = 0;
+    } else {
+        data = fetchPage(store, store->header.heap_page);
+    }
+    if (data == NULL) {
+        return 0;
+    }
+
+    memcpy(data + store->header.heap_used, text, length);
+    ref->page = store->header.heap_page;
+    ref->offset = (uint16_t)store->header.heap_used;
+    ref->length = (uint16_t)length;
+    store->header.heap_used += (uint32_t)length;
+    store->header_dirty = 1;
+    unpinPage(store, data, 1);
+    return 1;
+}
+
+// Copy a heap string into text (MAX_STRING bytes)
+static int readString(PagedStore *store, const StringRef *ref, char *text) {
+    unsigned char *data;
+
+    if (ref->length == 0) {
+        text[0] = '\0';
+        return 1;
+    }
+    if (ref->length >= MAX_STRING || ref->offset + ref->length > PAGE_SIZE) {
+        return 0;
+    }
+    data = fetchPage(store, ref->page);
+    if (data == NULL) {
+        return 0;
+    }
+    memcpy(text, data + ref->offset, ref->length);
+    text[ref->length] = '\0';
+    unpinPage(store, data, 0);
+    return 1;
+}
+
+// FNV-1a hash of the first length bytes of a string
+static uint32_t hashName(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Double the author dictionary. Returns 0 without memory
+static int growNames(PagedStore *store) {
+    int count = store->name_slots > 0 ? store->name_slots * 2 : 1024;
+    NameSlot *slots = malloc(sizeof(NameSlot) * count);
+    int i;
+
+    if (slots == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        slots[i].ref.length = 0xFFFF;
+    }
+    for (i = 0; i < store->name_slots; i++) {
+        if (store->names[i].ref.length != 0xFFFF) {
+            int slot = store->names[i].hash & (count - 1);
+            while (slots[slot].ref.length != 0xFFFF) slot = (slot + 1) & (count - 1);
+            slots[slot] = store->names[i];
+        }
+    }
+    free(store->names);
+    store->names = slots;
+    store->name_slots = count;
+    return 1;
+}
+
+// Store an author name once: reuse the heap copy of a name written earlier
+// by this process, or append it. Names written by other processes are not
+// known here and get their own copy, which is only a little extra space
+static int internString(PagedStore *store, const char *text, StringRef *ref) {
+    size_t length = strlen(text);
+    uint32_t hash;
+    int slot;
+
+    if (length >= MAX_STRING) {
+        length = MAX_STRING - 1;
+    }
+    if (store->name_count * 2 >= store->name_slots && !growNames(store)) {
+        return writeString(store, text, ref); // no memory: just don't share
+    }
+
+    hash = hashName(text, length);
+    slot = hash & (store->name_slots - 1);
+    while (store->names[slot].ref.length != 0xFFFF) {
+        NameSlot *name = &store->names[slot];
+
+        if (name->hash == hash && name->ref.length == length) {
+            unsigned char *data = fetchPage(store, name->ref.page);
+            int same;
+
+            if (data == NULL) {
+                return 0;
+            }
+            same = memcmp(data + name->ref.offset, text, length) == 0;
+            unpinPage(store, data, 0);
+            if (same) {
+                *ref = name->ref;
+                return 1;
+            }
+        }
+        slot = (slot + 1) & (store->name_slots - 1);
+    }
+
+    if (!writeString(store, text, ref)) {
+        return 0;
+    }
+    store->names[slot].hash = hash;
+    store->names[slot].ref = *ref;
+    store->name_count++;
+    return 1;
+}
+
+// Fill a PagedBook from a stored record and its heap strings
+static int loadBook(PagedStore *store, const StoredBook *stored, PagedBook *record) {
+    record->id = stored->id;
+    record->available = stored->available;
+    return readString(store, &stored->title, record->title) &&
+           readString(store, &stored->author, record->author);
+}
+
+// Point lookup by book ID. Returns 1 if found
+int pagedLookup(PagedStore *store, int id, PagedBook *record) {
+    Tree tree = bookTree(store);
+    StoredBook stored;
+    int32_t key = id;
+
+    return treeLookup(store, &tree, &key, &stored) && loadBook(store, &stored, record);
+}
+
+// Insert a book record, or replace it if its ID already exists. The heap
+// space of replaced strings is not reused
+int pagedPut(PagedStore *store, const PagedBook *record) {
+    Tree tree = bookTree(store);
+    StoredBook stored;
+
+    memset(&stored, 0, sizeof(stored));
+    stored.id = record->id;
+    stored.available = record->available;
+    if (!writeString(store, record->title, &stored.title) ||
+        !internString(store, record->author, &stored.author)) {
+        return 0;
+    }
+    return treePut(store, &tree, &stored);
+}
+
+// Set the availability flag of a book in place. Returns 1 if the book
+// exists, 0 if not. Only its leaf is read and, if the flag changes, written
+int pagedSetAvailable(PagedStore *store, int id, int available) {
+    Tree tree = bookTree(store);
+    int32_t key = id;
+    unsigned char *leaf = findLeaf(store, &tree, &key);
+    StoredBook *stored;
+    int pos;
+
+    if (leaf == NULL) {
+        return 0;
+    }
+    pos = leafPosition(&book_kind, leaf, &key);
+    if (pos >= (int)NODE(leaf)->count || compareBookKey(leafRecord(&book_kind, leaf, pos), &key) != 0) {
+        unpinPage(store, leaf, 0);
+        return 0;
+    }
+    stored = (StoredBook *)leafRecord(&book_kind, leaf, pos);
+    if (stored->available == available) {
+        unpinPage(store, leaf, 0);
+        return 1;
+    }
+    stored->available = available;
+    unpinPage(store, leaf, 1);
+    return 1;
+}
+
+// Adapts a typed scan callback to treeScan
+typedef struct {
+    PagedStore *store;
+    int (*visit_book)(const PagedBook *record, void *context);
+    int (*visit_loan)(int book_id, void *context);
+    void *context;
+} ScanVisitor;
+
+static int visitBook(const void *record, void *context) {
+    ScanVisitor *visitor = (ScanVisitor *)context;
+    PagedBook book;
+
+    if (!loadBook(visitor->store, (const StoredBook *)record, &book)) {
+        return 0;
+    }
+    return visitor->visit_book(&book, visitor->context);
+}
+
+static int visitLoan(const void *record, void *context) {
+    ScanVisitor *visitor = (ScanVisitor *)context;
+
+    return visitor->visit_loan(((const PagedLoan *)record)->book_id, visitor->context);
+}
+
+// Visit books with from_id <= ID <= to_id in ID order. Stops early when
+// visit returns 0 or a string can't be read. Returns the number of records
+// visited
+int pagedScan(PagedStore *store, int from_id, int to_id,
+              int (*visit)(const PagedBook *record, void *context), void *context) {
+    Tree tree = bookTree(store);
+    ScanVisitor visitor = { store, visit, NULL, context };
+    int32_t from = from_id, to = to_id;
+
+    return treeScan(store, &tree, &from, &to, visitBook, &visitor);
+}
+
+// Build a loan key. The username is zero-padded so stored pages do not
+// depend on stack contents
+static int makeLoanKey(PagedLoan *loan, const char *username, int book_id) {
+    if (strlen(username) >= MAX_STRING) {
+        return 0;
+    }
+    memset(loan, 0, sizeof(PagedLoan));
+    strcpy(loan->username, username);
+    loan->book_id = book_id;
+    return 1;
+}
+
+// Record that username has borrowed book_id
+int pagedPutLoan(PagedStore *store, const char *username, int book_id) {
+    Tree tree = loanTree(store);
+    PagedLoan loan;
+
+    if (!makeLoanKey(&loan, username, book_id)) {
+        return 0;
+    }
+    return treePut(store, &tree, &loan);
+}
+
+// Remove a loan. Returns 1 if it existed
+int pagedDeleteLoan(PagedStore *store, const char *username, int book_id) {
+    Tree tree = loanTree(store);
+    PagedLoan loan;
+
+    if (!makeLoanKey(&loan, username, book_id)) {
+        return 0;
+    }
+    return treeDelete(store, &tree, &loan);
+}
+
+// Visit the IDs of the books borrowed by username in ID order. Only the
+// leaves holding that user's loans are read. With a NULL username every
+// loan is visited. Returns the number visited
+int pagedScanLoans(PagedStore *store, const char *username,
+                   int (*visit)(int book_id, void *context), void *context) {
+    Tree tree = loanTree(store);
+    ScanVisitor visitor = { store, NULL, visit, context };
+    PagedLoan from, to;
+
+    if (username == NULL) {
+        // From the empty name to one above any real name
+        makeLoanKey(&from, "", INT_MIN);
+        memset(&to, 0xFF, sizeof(to));
+        to.username[MAX_STRING - 1] = '\0';
+        to.book_id = INT_MAX;
+    } else if (!makeLoanKey(&from, username, INT_MIN) || !makeLoanKey(&to, username, INT_MAX)) {
+        return 0;
+    }
+    return treeScan(store, &tree, &from, &to, visitLoan, &visitor);
+}